@@ -181,7 +181,7 @@ typedef struct {
     int numkpos;
     sfnkpos_t *kpos;
     long int total;
-    uint16_t *p;
+    uint16_t *p, *e;
     int np, ap, mx, my, lx, ly;
 } sfnctx_t;
 /**
@@ -543,6 +543,8 @@ void sfn_free()
     if(ctx.revision) free(ctx.revision);
     if(ctx.manufacturer) free(ctx.manufacturer);
     if(ctx.license) free(ctx.license);
+    if(ctx.p) free(ctx.p);
+    if(ctx.e) free(ctx.e);
     for(i = 0; i < 0x110000; i++)
         sfn_chardel(i);
     memset(&ctx, 0, sizeof(ctx));
@@ -1044,6 +1046,8 @@ int sfn_dump(ssfn_font_t *font, int size, int dump)
     unsigned char *ptr, *ptr2, *cmd;
     unsigned short *lig;
     ssfn_font_t *end;
+    ssfn_cidx_t *ix;
+    ssfn_cent_t *ce;
     int i, j, k, m, n, o, fn = 0, *fo = NULL, *ko = NULL;
 
     if(!font || size < 32) return 0;
@@ -1051,6 +1055,27 @@ int sfn_dump(ssfn_font_t *font, int size, int dump)
     if(!memcmp(font->magic, SSFN_COLLECTION, 4)) {
         printf("font/x-ssfont Scalable Screen Font Collection\n\n---Header---\nmagic: '%c%c%c%c'\nsize:  %d\n",
             font->magic[0], font->magic[1], font->magic[2], font->magic[3], font->size);
+        /* the optional index is the last chunk, its size is repeated in the last 4 bytes */
+        memcpy(&n, (uint8_t*)end - 4, 4);
+        ix = font->size >= 8 + sizeof(ssfn_cidx_t) + 4 && n >= (int)sizeof(ssfn_cidx_t) + 4 && n <= (int)font->size - 8 ?
+            (ssfn_cidx_t*)((uint8_t*)end - n) : NULL;
+        if(ix && (memcmp(ix->magic, SSFN_COLLIDX, 4) || (int)ix->size != n)) ix = NULL;
+        if(ix) {
+            printf("\n---Index---\nmagic: '%c%c%c%c'\nsize:  %d\n", ix->magic[0], ix->magic[1], ix->magic[2], ix->magic[3],
+                ix->size);
+            /* fonts compressed one by one can't be walked through, their size isn't known without the index */
+            printf("\n---Fonts---\n");
+            for(i = 0, ce = (ssfn_cent_t*)(ix + 1); i < (int)ix->num; i++) {
+                printf("%c%c%c%c %d %3d %s (offs %d size %d%s)\n", SSFN_TYPE_STYLE(ce->hdr.type) & SSFN_STYLE_BOLD ? 'b':'.',
+                    SSFN_TYPE_STYLE(ce->hdr.type) & SSFN_STYLE_ITALIC ? 'i':'.',
+                    SSFN_TYPE_STYLE(ce->hdr.type) & SSFN_STYLE_USRDEF1 ? 'u':'.',
+                    SSFN_TYPE_STYLE(ce->hdr.type) & SSFN_STYLE_USRDEF2 ? 'U':'.',
+                    SSFN_TYPE_FAMILY(ce->hdr.type), ce->hdr.height, (char*)ce + sizeof(ssfn_cent_t), ce->offs, ce->size,
+                    ((uint8_t*)font)[ce->offs] == 0x1f && ((uint8_t*)font)[ce->offs + 1] == 0x8b ? " gzip" : "");
+                ce = (ssfn_cent_t*)((uint8_t*)ce + sizeof(ssfn_cent_t) + ((strlen((char*)ce + sizeof(ssfn_cent_t)) + 4) & ~3));
+            }
+            return 1;
+        }
         printf("\n---Fonts---\n");
         for(font = (ssfn_font_t*)((uint8_t*)font + 8); font < end; font = (ssfn_font_t*)((uint8_t*)font + font->size)) {
             if(!memcmp(font->magic, "SSFN", 4)) printf("(obsolete SSFN1.0 font) %s\n", (char*)font + 64);
@@ -2270,7 +2295,8 @@ static void _sfn_l(int p, int h, int x, int y)
     if(ctx.ap <= ctx.np) {
         ctx.ap = ctx.np + 512;
         ctx.p = (uint16_t*)realloc(ctx.p, ctx.ap * sizeof(uint16_t));
-        if(!ctx.p) { ctx.ap = ctx.np = 0; return; }
+        ctx.e = (uint16_t*)realloc(ctx.e, (ctx.ap >> 1) * sizeof(uint16_t));
+        if(!ctx.p || !ctx.e) { ctx.ap = ctx.np = 0; return; }
     }
     if(!ctx.np) {
         ctx.p[0] = ctx.mx;
@@ -2313,7 +2339,7 @@ int sfn_glyph(int size, int unicode, int layer, int postproc, sfngc_t *g)
 {
     uint8_t ci = 0, cb = 0;
     uint16_t r[640];
-    int i, j, k, l, p, m, n, o, w, h, a, A, b, B, nr, x;
+    int i, j, k, l, p, m, n, o, w, h, a, A, b, B, nr, ne, na, ni;
     sfncont_t *cont;
 
     if(unicode < 0 || unicode > 0x10FFFF || !ctx.glyphs[unicode].numlayer || layer >= ctx.glyphs[unicode].numlayer ||
@@ -2355,28 +2381,15 @@ int sfn_glyph(int size, int unicode, int layer, int postproc, sfngc_t *g)
                 }
                 if(ctx.mx != ctx.lx || ctx.my != ctx.ly) _sfn_l(p << SSFN_PREC, h << SSFN_PREC, ctx.mx, ctx.my);
                 if(ctx.np > 4) {
-                    for(b = A = B = o = 0; b < h; b++, B += p) {
-                        a = b << SSFN_PREC;
-                        for(nr = 0, i = 0; i < ctx.np - 3; i += 2) {
-                            if( (ctx.p[i+1] < a && ctx.p[i+3] >= a) ||
-                                (ctx.p[i+3] < a && ctx.p[i+1] >= a)) {
-                                    if((ctx.p[i+1] >> SSFN_PREC) == (ctx.p[i+3] >> SSFN_PREC))
-                                        x = (((int)ctx.p[i]+(int)ctx.p[i+2])>>1);
-                                    else
-                                        x = ((int)ctx.p[i]) + ((a - (int)ctx.p[i+1])*
-                                            ((int)ctx.p[i+2] - (int)ctx.p[i])/
-                                            ((int)ctx.p[i+3] - (int)ctx.p[i+1]));
-                                    x >>= SSFN_PREC;
-                                    if(ci) x += (h - b) / SSFN_ITALIC_DIV;
-                                    if(cb && !o) {
-                                        if(g->data[B + x] == 0xFF) { o = -cb; A = cb; }
-                                        else { o = cb; A = -cb; }
-                                    }
-                                    for(k = 0; k < nr && x > r[k]; k++);
-                                    for(l = nr; l > k; l--) r[l] = r[l-1];
-                                    r[k] = x;
-                                    nr++;
-                            }
+                    /* same active edge table scan conversion as in ssfn_render() */
+                    ne = _ssfn_es(ctx.p, ctx.np, ctx.e); na = ni = 0;
+                    for(b = A = B = o = 0; b < h && (na || ni < ne); b++, B += p) {
+                        nr = _ssfn_ae(ctx.p, ctx.e, ne, &na, &ni, b, r, 640);
+                        if(ci) for(i = 0; i < nr; i++) r[i] += (h - b) / SSFN_ITALIC_DIV;
+                        if(cb && !o && nr) {
+                            for(k = 0, i = 1; i < nr; i++) if(ctx.e[i] < ctx.e[k]) k = i;
+                            if(g->data[B + r[k]] == 0xFF) { o = -cb; A = cb; }
+                            else { o = cb; A = -cb; }
                         }
                         if(nr > 1 && nr & 1) { r[nr - 2] = r[nr - 1]; nr--; }
                         if(nr) {
@@ -33,9 +33,25 @@
 #include "libsfn.h"
 #include "zlib.h"
 
-int zip = 1, ascii = 0, dump = 0, quiet = 0, lastpercent = 100;
+int zip = 1, zipfonts = 0, ascii = 0, dump = 0, quiet = 0, lastpercent = 100;
 char *_ssfn_zlib_decode(const char *buffer);
 
+/**
+ * Inflate a gzip compressed font in memory
+ */
+ssfn_font_t *inflate_font(uint8_t *ptr)
+{
+    uint8_t c, r;
+
+    ptr += 2;
+    if(*ptr++ != 8) return NULL;
+    c = *ptr++; ptr += 6;
+    if(c & 4) { r = *ptr++; r += (*ptr++ << 8); ptr += r; }
+    if(c & 8) { while(*ptr++ != 0); }
+    if(c & 16) { while(*ptr++ != 0); }
+    return (ssfn_font_t*)_ssfn_zlib_decode((const char*)ptr);
+}
+
 /**
  * Load a (compressed) file
  */
@@ -45,7 +61,7 @@ ssfn_font_t *load_file(char *infile, int *size)
     long int origsize = 0, fsize;
     FILE *f;
 #ifndef SSFN_MAXLINES
-    uint8_t c, r, *ptr;
+    uint8_t *ptr;
 #endif
 
     *size = 0;
@@ -66,15 +82,9 @@ badfile: fprintf(stderr,"sfnconv: unable to load '%s'\n", infile); exit(3);
 #ifdef SSFN_MAXLINES
         goto badfile;
 #else
-        ptr = (uint8_t*)data + 2;
-        data = (ssfn_font_t*)malloc(origsize);
-        if(!data) { fprintf(stderr,"sfnconv: memory allocation error\n"); exit(2); }
-        if(*ptr++ != 8) goto badfile;
-        c = *ptr++; ptr += 6;
-        if(c & 4) { r = *ptr++; r += (*ptr++ << 8); ptr += r; }
-        if(c & 8) { while(*ptr++ != 0); }
-        if(c & 16) { while(*ptr++ != 0); }
-        data = (ssfn_font_t*)_ssfn_zlib_decode((const char*)ptr);
+        ptr = (uint8_t*)data;
+        data = inflate_font(ptr);
+        free(ptr);
         if(!data) goto badfile;
         *size = origsize;
 #endif
@@ -83,36 +93,98 @@ badfile: fprintf(stderr,"sfnconv: unable to load '%s'\n", infile); exit(3);
     return data;
 }
 
+/**
+ * Gzip compress a font in memory
+ */
+unsigned char *compress_font(ssfn_font_t *font, unsigned long int *size)
+{
+    uint32_t crc;
+    z_stream stream;
+    unsigned char *buf;
+
+    stream.avail_out = compressBound(font->size) + 16;
+    buf = malloc(stream.avail_out);
+    if(!buf) { fprintf(stderr,"sfnconv: memory allocation error\n"); return NULL; }
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if(deflateInit(&stream, 9) != Z_OK) { fprintf(stderr,"sfnconv: deflate error\n"); free(buf); return NULL; }
+    stream.next_out = (z_const Bytef *)buf + 8;
+    stream.avail_in = font->size;
+    stream.next_in = (z_const Bytef *)font;
+    crc = crc32(0, stream.next_in, stream.avail_in);
+    deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    memset(buf, 0, 10);
+    buf[0] = 0x1f; buf[1] = 0x8b; buf[2] = 0x8; buf[9] = 3;
+    /* the gzip trailer replaces zlib's adler32 */
+    memcpy(buf + 4 + stream.total_out, &crc, 4);
+    memcpy(buf + 8 + stream.total_out, &font->size, 4);
+    *size = stream.total_out + 12;
+    return buf;
+}
+
+/**
+ * Collect the code points a font has a glyph for (or a ligature starting with) into a collection index entry
+ */
+void font_coverage(ssfn_font_t *font, uint8_t *cov)
+{
+    uint8_t *ptr, *end;
+    uint16_t *l;
+    uint32_t i, j;
+    char *s;
+
+    memset(cov, 0, 16);
+    /* the characters table ends where the next table starts */
+    end = (uint8_t*)font + font->size - 4;
+    if(font->ligature_offs > font->characters_offs && (uint8_t*)font + font->ligature_offs < end)
+        end = (uint8_t*)font + font->ligature_offs;
+    if(font->kerning_offs > font->characters_offs && (uint8_t*)font + font->kerning_offs < end)
+        end = (uint8_t*)font + font->kerning_offs;
+    if(font->cmap_offs > font->characters_offs && (uint8_t*)font + font->cmap_offs < end)
+        end = (uint8_t*)font + font->cmap_offs;
+    for(ptr = (uint8_t*)font + font->characters_offs, i = 0; i < 0x110000 && ptr < end; i++) {
+        if(ptr[0] == 0xFF) { i += 65535; ptr++; }
+        else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
+        else if((ptr[0] & 0xC0) == 0x80) { j = (ptr[0] & 0x3F); i += j; ptr++; }
+        else {
+            cov[SSFN_COV_BIT(i) >> 3] |= 1 << (SSFN_COV_BIT(i) & 7);
+            ptr += 6 + ptr[1] * (ptr[0] & 0x40 ? 6 : 5);
+        }
+    }
+    if(font->ligature_offs)
+        for(l = (uint16_t*)((uint8_t*)font + font->ligature_offs), i = 0; i < SSFN_LIG_LAST - SSFN_LIG_FIRST + 1 &&
+          l[i] && l[i] < font->size; i++) {
+            s = (char*)font + l[i];
+            if((j = ssfn_utf8(&s)) < 0x110000) cov[SSFN_COV_BIT(j) >> 3] |= 1 << (SSFN_COV_BIT(j) & 7);
+        }
+}
+
+/**
+ * Find the index in a font collection (the last chunk, its size is repeated in the last 4 bytes)
+ */
+ssfn_cidx_t *find_index(ssfn_font_t *font)
+{
+    ssfn_cidx_t *ix;
+    uint32_t s;
+
+    if(font->size < 8 + sizeof(ssfn_cidx_t) + 4) return NULL;
+    memcpy(&s, (uint8_t*)font + font->size - 4, 4);
+    if(s < sizeof(ssfn_cidx_t) + 4 || s > font->size - 8) return NULL;
+    ix = (ssfn_cidx_t*)((uint8_t*)font + font->size - s);
+    return !memcmp(ix->magic, SSFN_COLLIDX, 4) && ix->size == s ? ix : NULL;
+}
+
 /**
  * Save a (compressed) file
  */
 void save_file(char *outfile, ssfn_font_t *font)
 {
     FILE *f;
-    uint32_t crc;
-    z_stream stream;
     unsigned char *buf = (unsigned char*)font;
     unsigned long int size = font->size;
 
-    if(zip) {
-        stream.avail_out = compressBound(font->size) + 16;
-        buf = malloc(stream.avail_out);
-        if(!buf) { fprintf(stderr,"sfnconv: memory allocation error\n"); return; }
-        stream.zalloc = (alloc_func)0;
-        stream.zfree = (free_func)0;
-        stream.opaque = (voidpf)0;
-        if(deflateInit(&stream, 9) != Z_OK) { fprintf(stderr,"sfnconv: deflate error\n"); return; }
-        stream.next_out = (z_const Bytef *)buf + 8;
-        stream.avail_in = font->size;
-        stream.next_in = (z_const Bytef *)font;
-        crc = crc32(0, stream.next_in, stream.avail_in);
-        deflate(&stream, Z_FINISH);
-        memset(buf, 0, 10);
-        buf[0] = 0x1f; buf[1] = 0x8b; buf[2] = 0x8; buf[9] = 3;
-        memcpy(buf + 8 + stream.total_out, &crc, 4);
-        memcpy(buf + 12 + stream.total_out, &font->size, 4);
-        size = stream.total_out + 16;
-    }
+    if(zip && !(buf = compress_font(font, &size))) return;
     f = fopen(outfile, "wb");
     if(!f) { fprintf(stderr, "sfnconv: unable to write '%s'\n", outfile); exit(4); }
     fwrite(buf, size, 1, f);
@@ -128,14 +200,15 @@ void usage()
     printf("Scalable Screen Font 2.0 by bzt Copyright (C) 2020 MIT license\n"
            " https://gitlab.com/bztsrc/scalable-font2\n"
            " UNICODE database: %s\n\n"
-           "./sfnconv [-c|-e|-d|-dd|-dd...|-D] [-C] [-U] "
+           "./sfnconv [-c [-z]|-e|-d|-dd|-dd...|-D] [-C] [-U] "
            "[-A] [-R] [-B <size>|-V] [-g]\n   [-b <p>] [-u <+p>] [-a <+p>] [-o] [-q] [-S <U+xxx>] [-E] [-t [b][i]<0..4>]"
            , uniname_date);
     printf("\n   [-n <name>] [-f <family>] [-s <subfamily>] [-v <ver>] [-m <manufacturer>] "
            "\n   [-l <license>] [-r <from> <to>] <in> [ [-r <from> <to>] <in> ...] <out>\n\n"
            " -c:  create font collection\n"
            " -e:  extract font collection\n"
-           " -d:  dump font (-d = header, -dd = string table, -ddd = fragments etc.)\n"
+           " -z:  with -c, compress fonts one by one (only the fonts used are inflated)\n");
+    printf(" -d:  dump font (-d = header, -dd = string table, -ddd = fragments etc.)\n"
            " -D:  dump all tables in the font\n"
            " -C:  UNICODE range coverage report\n"
            " -U:  save uncompressed, non-gzipped output\n"
@@ -207,11 +280,14 @@ void progressbar(int step, int numstep, int curr, int total, int msg)
  */
 int main(int argc, char **argv)
 {
-    int i, j, in = 0;
+    int i, j, k, n, in = 0;
     char *outfile = NULL, *c;
-    int size = 0, total = 8;
-    ssfn_font_t *font, *end;
-    unsigned char *out = NULL;
+    int size = 0, total = 8, idxlen = sizeof(ssfn_cidx_t);
+    ssfn_font_t *font, *end, *fnt, *hdr;
+    ssfn_cidx_t *ix;
+    ssfn_cent_t *ce = NULL;
+    unsigned char *out = NULL, *idx = NULL, *buf;
+    unsigned long int len;
 
     /* parse flags and arguments */
     if(argc<3) usage();
@@ -220,21 +296,53 @@ int main(int argc, char **argv)
         /* create collection */
         if(argc<5) usage();
         i = 2;
-        for(; i<argc && argv[i][0] == '-'; i++)
+        for(; i<argc && argv[i][0] == '-'; i++) {
             if(argv[i][0] == '-' && argv[i][1] == 'U') zip = 0;
-        for(; i + 1 < argc; i++) {
+            if(argv[i][0] == '-' && argv[i][1] == 'z') zipfonts = 1;
+        }
+        /* compressing the fonts one by one and the collection again makes no sense */
+        if(zipfonts) zip = 0;
+        for(k = 0; i + 1 < argc; i++, k++) {
             font = load_file(argv[i], &size);
             if(memcmp(font->magic, SSFN_MAGIC, 4)) {
                 fprintf(stderr, "sfnconv: not an SSFN font '%s'\n", argv[i]);
                 return 1;
             }
-            out = (unsigned char *)realloc(out, total+size);
-            memcpy(out + total, font, font->size);
-            total += size;
+            buf = (unsigned char*)font; len = font->size;
+            if(zipfonts && !(buf = compress_font(font, &len))) return 2;
+            out = (unsigned char *)realloc(out, total+len);
+            if(!out) { fprintf(stderr,"sfnconv: memory allocation error\n"); return 2; }
+            memcpy(out + total, buf, len);
+            /* index entry, the coverage, a copy of the header and the unique name so that the font can be selected (or
+             * skipped when looking for a fallback glyph) without reading it */
+            n = strlen((char*)font + sizeof(ssfn_font_t)) + 1;
+            j = sizeof(ssfn_cent_t) + ((n + 3) & ~3);
+            idx = (unsigned char *)realloc(idx, idxlen + j);
+            if(!idx) { fprintf(stderr,"sfnconv: memory allocation error\n"); return 2; }
+            memset(idx + idxlen, 0, j);
+            ce = (ssfn_cent_t*)(idx + idxlen);
+            ce->offs = total; ce->size = len;
+            memcpy(&ce->hdr, font, sizeof(ssfn_font_t));
+            font_coverage(font, ce->cov);
+            memcpy(idx + idxlen + sizeof(ssfn_cent_t), (char*)font + sizeof(ssfn_font_t), n);
+            idxlen += j;
+            total += len;
             size = 0;
+            if(buf != (unsigned char*)font) free(buf);
             free(font);
         }
         if(out) {
+            /* the index is the last chunk, readers that don't know about it stop there */
+            idx = (unsigned char *)realloc(idx, idxlen + 4);
+            out = (unsigned char *)realloc(out, total + idxlen + 4);
+            if(!idx || !out) { fprintf(stderr,"sfnconv: memory allocation error\n"); return 2; }
+            ix = (ssfn_cidx_t*)idx;
+            memcpy(ix->magic, SSFN_COLLIDX, 4);
+            idxlen += 4; ix->size = idxlen; ix->num = k;
+            memcpy(idx + idxlen - 4, &idxlen, 4);
+            memcpy(out + total, idx, idxlen);
+            total += idxlen;
+            free(idx);
             memcpy(out, SSFN_COLLECTION, 4);
             memcpy(out + 4, &total, 4);
             save_file(argv[i], (ssfn_font_t*)out);
@@ -252,17 +360,31 @@ int main(int argc, char **argv)
             return 1;
         }
         end = (ssfn_font_t*)((uint8_t*)font + font->size);
-        for(i++, font = (ssfn_font_t*)((uint8_t*)font + 8); font < end; font = (ssfn_font_t*)((uint8_t*)font + font->size)) {
+        /* with an index, fonts are found without walking through them, and they might be compressed one by one */
+        if((ix = find_index(font))) ce = (ssfn_cent_t*)(ix + 1);
+        for(i++, k = 0, fnt = (ssfn_font_t*)((uint8_t*)font + 8); ix ? k < (int)ix->num : fnt < end; k++) {
+            if(ix) { hdr = &ce->hdr; fnt = (ssfn_font_t*)((uint8_t*)font + ce->offs); } else hdr = fnt;
             if(argc < 4) {
                 if(!j) { j = 1; printf("-t\t-B\t-n\n"); }
-                printf("%s%s%s%s%d\t%d\t%s\n", SSFN_TYPE_STYLE(font->type) & SSFN_STYLE_BOLD ? "b":"",
-                    SSFN_TYPE_STYLE(font->type) & SSFN_STYLE_ITALIC ? "i":"",
-                    SSFN_TYPE_STYLE(font->type) & SSFN_STYLE_USRDEF1 ? "u":"",
-                    SSFN_TYPE_STYLE(font->type) & SSFN_STYLE_USRDEF2 ? "U":"",
-                    SSFN_TYPE_FAMILY(font->type), font->height,
-                    (char*)font + sizeof(ssfn_font_t));
-            } else
-                save_file(argv[i++], font);
+                printf("%s%s%s%s%d\t%d\t%s\n", SSFN_TYPE_STYLE(hdr->type) & SSFN_STYLE_BOLD ? "b":"",
+                    SSFN_TYPE_STYLE(hdr->type) & SSFN_STYLE_ITALIC ? "i":"",
+                    SSFN_TYPE_STYLE(hdr->type) & SSFN_STYLE_USRDEF1 ? "u":"",
+                    SSFN_TYPE_STYLE(hdr->type) & SSFN_STYLE_USRDEF2 ? "U":"",
+                    SSFN_TYPE_FAMILY(hdr->type), hdr->height,
+                    (char*)hdr + sizeof(ssfn_font_t));
+            } else if(i < argc) {
+                if(((uint8_t*)fnt)[0] == 0x1f && ((uint8_t*)fnt)[1] == 0x8b) {
+                    if(!(hdr = inflate_font((uint8_t*)fnt))) {
+                        fprintf(stderr, "sfnconv: unable to inflate font %d\n", k); return 1;
+                    }
+                    save_file(argv[i++], hdr);
+                    free(hdr);
+                } else
+                    save_file(argv[i++], fnt);
+            }
+            if(ix) ce = (ssfn_cent_t*)((uint8_t*)ce + sizeof(ssfn_cent_t) +
+                ((strlen((char*)ce + sizeof(ssfn_cent_t)) + 4) & ~3));
+            else fnt = (ssfn_font_t*)((uint8_t*)fnt + fnt->size);
         }
         return 0;
     }
@@ -27,10 +27,25 @@
  *
  */
 
+#define _POSIX_C_SOURCE 199309L
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+/**
+ * Profiling clock in nanoseconds (the default counts CPU ticks)
+ */
+uint64_t demo_clock(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000UL + (uint64_t)t.tv_nsec;
+}
+
 #define SSFN_IMPLEMENTATION
 #define SSFN_PROFILING
+#define SSFN_CLOCK demo_clock
 #define SSFN_CONSOLEBITMAP_TRUECOLOR
 /*#define SSFN_MAXLINES 4096*/
 #include "../ssfn.h"
@@ -129,6 +144,7 @@ void do_test(SDL_Surface *screen, char *fontfn)
     int sintbl[] = { 0, 1, 5, 9, 14, 21, 28, 36, 56, 67, 78, 67, 56, 46, 36, 28, 21, 14, 9, 5, 1 };
     int ret, size, i;
     ssfn_t ctx;
+    ssfn_stats_t st;
 
     /* initialize the normal renderer */
     memset(&ctx, 0, sizeof(ssfn_t));
@@ -499,13 +515,17 @@ void do_test(SDL_Surface *screen, char *fontfn)
 
     printf("Memory allocated: %d, sizeof(ssfn_t) = %d\n\n", ssfn_mem(&ctx), (int)sizeof(ssfn_t));
     printf("File load time:    %3ld.%06ld sec\n", loadtim / 1000000L, loadtim % 1000000L);
-    printf("Character lookup:  %3ld.%06ld sec\n", ctx.lookup / 1000000L, ctx.lookup % 1000000L);
-    printf("Rasterization:     %3ld.%06ld sec\n", ctx.raster / 1000000L, ctx.raster % 1000000L);
-    printf("Blitting:          %3ld.%06ld sec\n", ctx.blit / 1000000L, ctx.blit % 1000000L);
-    printf("Kerning:           %3ld.%06ld sec\n", ctx.kern / 1000000L, ctx.kern % 1000000L);
-    loadtim = ctx.blit - ctx.raster;
+    ssfn_stats(&ctx, &st, 0);
+    for(i = 0; i < 4; i++) st.time[i] /= 1000;
+    printf("Character lookup:  %3ld.%06ld sec\n", (long)st.time[0] / 1000000L, (long)st.time[0] % 1000000L);
+    printf("Rasterization:     %3ld.%06ld sec\n", (long)st.time[1] / 1000000L, (long)st.time[1] % 1000000L);
+    printf("Blitting:          %3ld.%06ld sec\n", (long)st.time[2] / 1000000L, (long)st.time[2] % 1000000L);
+    printf("Kerning:           %3ld.%06ld sec\n", (long)st.time[3] / 1000000L, (long)st.time[3] % 1000000L);
+    loadtim = (long)st.time[2] - (long)st.time[1];
     if(loadtim < 0) { i = '-'; loadtim = -loadtim; } else i = ' ';
     printf("Raster/blit diff: %c%3ld.%06ld sec\n", i, loadtim / 1000000L, loadtim % 1000000L);
+    printf("Glyphs from cache: %u, rasterized: %u, fonts probed: %u, sketches: %lu bytes\n", st.hits, st.misses,
+        st.probes, (unsigned long)st.sketch);
     ssfn_free(&ctx);
     free(ssfn_src);
 }
@@ -0,0 +1,141 @@
+/*
+ * sfntest7.c
+ *
+ * Copyright (C) 2021 bzt (bztsrc@gitlab)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * @brief checks that the box filter blitter is bit-exact with the generic loop, by hashing every rendered case
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#define SSFN_IMPLEMENTATION
+#include "../ssfn.h"
+
+/**
+ * Load a font
+ */
+ssfn_font_t *load_file(char *filename, int *size)
+{
+    char *fontdata = NULL;
+    FILE *f;
+
+    f = fopen(filename, "rb");
+    if(!f) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    *size = 0;
+    fseek(f, 0, SEEK_END);
+    *size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(!*size) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    fontdata = (char*)malloc(*size);
+    if(!fontdata) { fprintf(stderr,"memory allocation error\n"); exit(2); }
+    fread(fontdata, *size, 1, f);
+    fclose(f);
+    return (ssfn_font_t*)fontdata;
+}
+
+/**
+ * FNV-1a hash of the off-screen buffer, continuing h
+ */
+unsigned long hash(unsigned long h, uint8_t *p, int n)
+{
+    for(; n > 0; n--, p++)
+        h = ((h ^ *p) * 16777619UL) & 0xFFFFFFFFUL;
+    return h;
+}
+
+/**
+ * render every combination of size, style, foreground alpha, background and pixel order with a font, returns the hash
+ */
+unsigned long do_test(char *fontfn, char *str)
+{
+    int sizes[] = { 8, 11, 16, 24, 48, 0 }, styles[] = { SSFN_STYLE_REGULAR, SSFN_STYLE_BOLD, SSFN_STYLE_ITALIC,
+        SSFN_STYLE_BOLD | SSFN_STYLE_ITALIC, SSFN_STYLE_UNDERLINE, SSFN_STYLE_NOAA, SSFN_STYLE_COVERAGE, SSFN_STYLE_MASKCACHE,
+        SSFN_STYLE_BOLD | SSFN_STYLE_MASKCACHE, -1 };
+    uint32_t fgs[] = { 0xFF202020, 0x80F02040, 0 }, bgs[] = { 0, 0xFF405060, 0x20FFFFFF, 1 };
+    unsigned long h = 2166136261UL;
+    int ret, size, i, j, k, l, o;
+    char *s;
+    ssfn_t ctx;
+    ssfn_font_t *font;
+    ssfn_buf_t buf;
+
+    memset(&ctx, 0, sizeof(ssfn_t));
+    memset(&buf, 0, sizeof(ssfn_buf_t));
+    buf.p = 1024 * 4;
+    buf.h = 160;
+    buf.ptr = (uint8_t*)malloc(buf.p * buf.h);
+    if(!buf.ptr) { fprintf(stderr, "unable to allocate off-screen buffer\r\n"); exit(1); }
+
+    font = load_file(fontfn, &size);
+    ret = ssfn_load(&ctx, font);
+    if(ret != SSFN_OK) { fprintf(stderr, "ssfn load error: err=%d %s\n", ret, ssfn_error(ret)); free(buf.ptr); exit(2); }
+
+    for(i = 0; sizes[i]; i++)
+        for(j = 0; styles[j] != -1; j++)
+            for(k = 0; fgs[k]; k++)
+                for(l = 0; bgs[l] != 1; l++)
+                    for(o = 0; o < 2; o++) {
+                        ret = ssfn_select(&ctx, SSFN_FAMILY_ANY, NULL, styles[j], sizes[i]);
+                        if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+                        /* pattern in the buffer, so that alpha blending with the background can be checked too */
+                        for(ret = 0; ret < buf.p * buf.h; ret++) buf.ptr[ret] = (uint8_t)(ret * 7);
+                        buf.w = o ? -1024 : 1024;
+                        buf.fg = fgs[k];
+                        buf.bg = bgs[l];
+                        buf.x = 4; buf.y = sizes[i] + 4;
+                        for(s = str; (ret = ssfn_render(&ctx, &buf, s)) > 0; s += ret);
+                        if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+                        h = hash(h, buf.ptr, buf.p * buf.h);
+                    }
+
+    ssfn_free(&ctx);
+    free(font);
+    free(buf.ptr);
+    return h;
+}
+
+/**
+ * Main procedure
+ */
+int main(int argc, char **argv)
+{
+    /* what the generic loop in ssfn_render() gives, without the box filter's shortcuts */
+    char *fonts[] = { "../fonts/FreeSerif.sfn", "../fonts/VeraBI.sfn", "../fonts/chrome.sfn", "../fonts/emoji.sfn",
+        "../fonts/unifont.sfn.gz", NULL };
+    char *strs[] = { "f Checking the Bounding Box F", "Quick brown fox jumps", "COLORFULCHROME",
+        "\xF0\x9F\x98\x80\xF0\x9F\x98\x8E\xF0\x9F\x98\x8D", "Unifont \xE6\xBC\xA2\xE5\xAD\x97 \xD0\x96" };
+    unsigned long hashes[] = { 0x2c9e1c4dUL, 0x0a6978b4UL, 0x4706934cUL, 0x42a32101UL, 0x401efa6dUL }, h;
+    int i, ret = 0;
+
+    if(argc > 1) {
+        printf("%08lx\n", do_test(argv[1], argc > 2 ? argv[2] : "Checking the Bounding Box"));
+        return 0;
+    }
+    for(i = 0; fonts[i]; i++) {
+        h = do_test(fonts[i], strs[i]);
+        printf("%s %08lx %s\n", fonts[i], h, h == hashes[i] ? "OK" : "MISMATCH");
+        if(h != hashes[i]) ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,235 @@
+/*
+ * sfntest8.c
+ *
+ * Copyright (C) 2021 bzt (bztsrc@gitlab)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * @brief multi-threaded benchmark, renders with 1 to 16 threads sharing the fonts (and with SSFN_SHAREDCACHE the glyph cache,
+ * which is also preloaded on a background thread)
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#define SSFN_IMPLEMENTATION
+#include "../ssfn.h"
+
+#define MAXTHREADS 16
+
+ssfn_t fonts;
+int iter = 5, glyphs[MAXTHREADS];
+int sizes[] = { 10, 12, 16, 20, 24, 32, 0 }, families[] = { SSFN_FAMILY_SERIF, SSFN_FAMILY_SANS, -1 };
+double one = 0.0;
+struct timespec pt;
+unsigned long hashes[MAXTHREADS];
+char *strs[] = {
+    "The quick brown fox jumps over the lazy dog 0123456789",
+    "Pack my box with five dozen liquor jugs! AV Wa To",
+    "\xD0\x91\xD1\x8B\xD1\x81\xD1\x82\xD1\x80\xD0\xB0\xD1\x8F \xCE\xB1\xCE\xB2\xCE\xB3\xCE\xB4 "
+    "\xE6\xBC\xA2\xE5\xAD\x97\xE3\x81\x8B\xE3\x81\xAA \xE2\x82\xAC\xE2\x84\xA2",
+    NULL };
+
+/**
+ * Load a font
+ */
+ssfn_font_t *load_file(char *filename, int *size)
+{
+    char *fontdata = NULL;
+    FILE *f;
+
+    f = fopen(filename, "rb");
+    if(!f) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    *size = 0;
+    fseek(f, 0, SEEK_END);
+    *size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(!*size) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    fontdata = (char*)malloc(*size);
+    if(!fontdata) { fprintf(stderr,"memory allocation error\n"); exit(2); }
+    fread(fontdata, *size, 1, f);
+    fclose(f);
+    return (ssfn_font_t*)fontdata;
+}
+
+/**
+ * FNV-1a hash of the off-screen buffer
+ */
+unsigned long hash(uint8_t *p, int n)
+{
+    unsigned long h = 2166136261UL;
+    for(; n > 0; n--, p++)
+        h = ((h ^ *p) * 16777619UL) & 0xFFFFFFFFUL;
+    return h;
+}
+
+/**
+ * one thread: render every string with every face and size a few times, with its own context
+ */
+void *do_thread(void *arg)
+{
+    int t = (int)(long)arg, ret, i, j, k, l;
+    char *s;
+    ssfn_t ctx;
+    ssfn_buf_t buf;
+
+    memset(&ctx, 0, sizeof(ssfn_t));
+    memset(&buf, 0, sizeof(ssfn_buf_t));
+    buf.w = 640; buf.h = 48; buf.p = buf.w * 4; buf.fg = 0xFF202020; buf.bg = 0;
+    buf.ptr = (uint8_t*)malloc(buf.p * buf.h);
+    if(!buf.ptr) { fprintf(stderr, "unable to allocate off-screen buffer\r\n"); exit(1); }
+    if((ret = ssfn_share(&ctx, &fonts)) != SSFN_OK) {
+        fprintf(stderr, "ssfn share error: err=%d %s\n", ret, ssfn_error(ret)); exit(2);
+    }
+    glyphs[t] = 0; hashes[t] = 0;
+    for(i = 0; i < iter; i++)
+        for(j = 0; families[j] != -1; j++)
+            for(k = 0; sizes[k]; k++)
+                for(l = 0; strs[l]; l++) {
+                    ret = ssfn_select(&ctx, families[j], NULL, SSFN_STYLE_REGULAR, sizes[k]);
+                    if(ret != SSFN_OK) { fprintf(stderr, "ssfn select error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+                    memset(buf.ptr, 0, buf.p * buf.h);
+                    buf.x = 4; buf.y = sizes[k] + 4;
+                    for(s = strs[l]; (ret = ssfn_render(&ctx, &buf, s)) > 0; s += ret) glyphs[t]++;
+                    if(ret != SSFN_OK) { fprintf(stderr, "ssfn render error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+                    if(!i) hashes[t] ^= hash(buf.ptr, buf.p * buf.h) + l * 31 + k * 7 + j;
+                }
+    ssfn_free(&ctx);
+    free(buf.ptr);
+    return NULL;
+}
+
+#ifdef SSFN_SHAREDCACHE
+/**
+ * completion callback of the preload
+ */
+void preloaded(int n)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    printf("preloaded %d glyphs on a background thread in %.1f ms\n", n,
+        (double)(t.tv_sec - pt.tv_sec) * 1000.0 + (double)(t.tv_nsec - pt.tv_nsec) / 1000000.0);
+}
+
+/**
+ * warm the shared glyph cache with the code points of the strings for every face and size, like an application would
+ * at startup, then call the completion callback
+ */
+void *do_preload(void *arg)
+{
+    uint32_t ranges[] = { 32, 126, 0x3B1, 0x3B4, 0x410, 0x44F, 0x304B, 0x304B, 0x306A, 0x306A, 0x5B57, 0x5B57,
+        0x6F22, 0x6F22, 0x20AC, 0x20AC, 0x2122, 0x2122, 0 };
+    int ret, j, k, l, n = 0;
+    ssfn_t ctx;
+
+    memset(&ctx, 0, sizeof(ssfn_t));
+    if((ret = ssfn_share(&ctx, &fonts)) != SSFN_OK) {
+        fprintf(stderr, "ssfn share error: err=%d %s\n", ret, ssfn_error(ret)); exit(2);
+    }
+    for(j = 0; families[j] != -1; j++)
+        for(k = 0; sizes[k]; k++) {
+            ssfn_select(&ctx, families[j], NULL, SSFN_STYLE_REGULAR, sizes[k]);
+            for(l = 0; ranges[l]; l += 2) {
+                if((ret = ssfn_preload(&ctx, ranges[l], ranges[l + 1])) < 0) {
+                    fprintf(stderr, "ssfn preload error: err=%d %s\n", ret, ssfn_error(ret)); exit(2);
+                }
+                n += ret;
+            }
+        }
+    ssfn_free(&ctx);
+    preloaded(n);
+    return arg;
+}
+#endif
+
+/**
+ * run the same work on n threads at once, and compare the throughput to one thread
+ */
+void do_test(int n, int flush)
+{
+    pthread_t th[MAXTHREADS];
+    struct timespec t0, t1;
+    double sec;
+    long i;
+    int total = 0;
+
+    /* every round starts with an empty cache, unless it was preloaded */
+    if(flush) ssfn_flush(&fonts);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < n; i++)
+        if(pthread_create(&th[i], NULL, do_thread, (void*)i)) { fprintf(stderr, "unable to create thread\n"); exit(1); }
+    for(i = 0; i < n; i++)
+        pthread_join(th[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1000000000.0;
+    for(i = 0; i < n; i++) {
+        total += glyphs[i];
+        if(hashes[i] != hashes[0]) { fprintf(stderr, "thread %ld rendered something else than thread 0\n", i); exit(1); }
+    }
+    if(!one) one = total / sec;
+    printf("%2d threads: %8.1f ms, %9.0f glyphs/sec (%5.2fx), memory %d bytes\n", n, sec * 1000.0, total / sec,
+        total / sec / one, ssfn_mem(&fonts));
+}
+
+/**
+ * Main procedure
+ */
+int main(int argc, char **argv)
+{
+    char *fontfn[] = { "../fonts/FreeSerif.sfn", "../fonts/FreeSans.sfn", "../fonts/unifont.sfn.gz", NULL };
+    int ret, size, i;
+    ssfn_font_t *font[3];
+#ifdef SSFN_SHAREDCACHE
+    pthread_t th;
+#endif
+
+    if(argc > 1 && atoi(argv[1]) > 0) iter = atoi(argv[1]);
+    memset(&fonts, 0, sizeof(ssfn_t));
+    for(i = 0; fontfn[i]; i++) {
+        font[i] = load_file(fontfn[i], &size);
+        ret = ssfn_load(&fonts, font[i]);
+        if(ret != SSFN_OK) { fprintf(stderr, "ssfn load error: err=%d %s\n", ret, ssfn_error(ret)); exit(2); }
+    }
+#ifdef SSFN_SHAREDCACHE
+    printf("shared glyph cache, %d iterations per thread\n", iter);
+#else
+    printf("glyph cache per thread, %d iterations per thread\n", iter);
+#endif
+    for(i = 1; i <= MAXTHREADS; i <<= 1)
+        do_test(i, 1);
+#ifdef SSFN_SHAREDCACHE
+    /* the render threads only start after the completion callback here, but they could already run meanwhile */
+    ssfn_flush(&fonts);
+    clock_gettime(CLOCK_MONOTONIC, &pt);
+    if(pthread_create(&th, NULL, do_preload, NULL)) { fprintf(stderr, "unable to create thread\n"); exit(1); }
+    pthread_join(th, NULL);
+    printf("after preload:\n");
+    for(i = 1; i <= MAXTHREADS; i <<= 1)
+        do_test(i, 0);
+#endif
+    ssfn_free(&fonts);
+    for(i = 0; fontfn[i]; i++) free(font[i]);
+    return 0;
+}
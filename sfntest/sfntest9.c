@@ -0,0 +1,168 @@
+/*
+ * sfntest9.c
+ *
+ * Copyright (C) 2021 bzt (bztsrc@gitlab)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * @brief inflate round-trip test, checks the built-in inflater against the gzip trailers of the fonts (and zlib)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if HAS_ZLIB
+#include <zlib.h>
+#endif
+#define SSFN_IMPLEMENTATION
+#include "../ssfn.h"
+
+#define ITER 20
+
+/* all fonts in the repository are gzip compressed, whatever their extension is */
+char *fontfn[] = { "../fonts/FreeSans.sfn", "../fonts/FreeSansB.sfn", "../fonts/FreeSansI.sfn", "../fonts/FreeSerif.sfn",
+    "../fonts/FreeSerifB.sfn", "../fonts/FreeSerifI.sfn", "../fonts/Vera.sfn", "../fonts/VeraB.sfn", "../fonts/VeraBI.sfn",
+    "../fonts/VeraI.sfn", "../fonts/VeraR.sfn", "../fonts/bende.sfn", "../fonts/chrome.sfn", "../fonts/creep.sfn.gz",
+    "../fonts/emoji.sfn", "../fonts/stoneage.sfn", "../fonts/u_vga16.sfn.gz", "../fonts/unifont.sfn.gz", NULL };
+uint32_t crctbl[256];
+
+/**
+ * Load a file
+ */
+uint8_t *load_file(char *filename, int *size)
+{
+    uint8_t *data = NULL;
+    FILE *f;
+
+    f = fopen(filename, "rb");
+    if(!f) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    *size = 0;
+    fseek(f, 0, SEEK_END);
+    *size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(!*size) { fprintf(stderr,"unable to load %s\n", filename); exit(3); }
+    data = (uint8_t*)malloc(*size);
+    if(!data) { fprintf(stderr,"memory allocation error\n"); exit(2); }
+    fread(data, *size, 1, f);
+    fclose(f);
+    return data;
+}
+
+/**
+ * CRC32 as in the gzip trailer
+ */
+uint32_t crc32_calc(uint8_t *p, int n)
+{
+    uint32_t c = 0xFFFFFFFF;
+    for(; n > 0; n--, p++)
+        c = crctbl[(c ^ *p) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFF;
+}
+
+/**
+ * inflate a gzip stream and check the result against its trailer, returns the inflated buffer
+ */
+char *check(char *name, uint8_t *data, int size, double *sec)
+{
+    char *out, peek[SSFN_PEEK_MAX];
+    uint32_t len = data[size-4] | (data[size-3] << 8) | (data[size-2] << 16) | ((uint32_t)data[size-1] << 24);
+    uint32_t crc = data[size-8] | (data[size-7] << 8) | (data[size-6] << 16) | ((uint32_t)data[size-5] << 24);
+    clock_t t;
+    int i, n;
+
+    if(data[0] != 0x1f || data[1] != 0x8b) { fprintf(stderr, "%s: not gzip compressed\n", name); exit(1); }
+    out = _ssfn_zlib_decode((const char*)_ssfn_gz(data));
+    if(!out) { fprintf(stderr, "%s: unable to inflate\n", name); exit(1); }
+    if(((ssfn_font_t*)out)->size != len || crc32_calc((uint8_t*)out, len) != crc) {
+        fprintf(stderr, "%s: inflated data doesn't match the gzip trailer\n", name); exit(1);
+    }
+    /* partial inflate (used by ssfn_map) must give the same first bytes, it stops before a match that doesn't fit */
+    n = _ssfn_zp(_ssfn_gz(data), peek, SSFN_PEEK_MAX);
+    if(n < 0 || n > SSFN_PEEK_MAX || memcmp(peek, out, n)) {
+        fprintf(stderr, "%s: partial inflate doesn't match\n", name); exit(1);
+    }
+    if(sec) {
+        t = clock();
+        for(i = 0; i < ITER; i++) free(_ssfn_zlib_decode((const char*)_ssfn_gz(data)));
+        *sec = (double)(clock() - t) / CLOCKS_PER_SEC / ITER;
+    }
+    return out;
+}
+
+#if HAS_ZLIB
+/**
+ * compress with zlib at a given level and inflate it back with ours (level 0 gives stored blocks)
+ */
+void roundtrip(char *name, char *font, int level)
+{
+    z_stream s;
+    uint8_t *gz;
+    char *out;
+    uLong n;
+
+    memset(&s, 0, sizeof(s));
+    if(deflateInit2(&s, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) { fprintf(stderr, "zlib error\n"); exit(2); }
+    n = deflateBound(&s, ((ssfn_font_t*)font)->size);
+    gz = (uint8_t*)malloc(n);
+    if(!gz) { fprintf(stderr,"memory allocation error\n"); exit(2); }
+    s.next_in = (Bytef*)font; s.avail_in = ((ssfn_font_t*)font)->size;
+    s.next_out = gz; s.avail_out = n;
+    if(deflate(&s, Z_FINISH) != Z_STREAM_END) { fprintf(stderr, "zlib error\n"); exit(2); }
+    deflateEnd(&s);
+    out = check(name, gz, (int)s.total_out, NULL);
+    if(memcmp(out, font, ((ssfn_font_t*)font)->size)) { fprintf(stderr, "%s: level %d round-trip differs\n", name, level); exit(1); }
+    free(out);
+    free(gz);
+}
+#endif
+
+/**
+ * Main procedure
+ */
+int main()
+{
+    uint32_t c;
+    int i, j, size;
+    uint8_t *data;
+    char *out;
+    double sec;
+
+    for(i = 0; i < 256; i++) {
+        for(c = i, j = 0; j < 8; j++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crctbl[i] = c;
+    }
+    for(i = 0; fontfn[i]; i++) {
+        data = load_file(fontfn[i], &size);
+        out = check(fontfn[i], data, size, &sec);
+        printf("%-26s %8d bytes %8.3f ms %8.1f MB/s\n", fontfn[i], ((ssfn_font_t*)out)->size, sec * 1000.0,
+            sec > 0.0 ? ((ssfn_font_t*)out)->size / sec / 1048576.0 : 0.0);
+#if HAS_ZLIB
+        roundtrip(fontfn[i], out, 0);
+        roundtrip(fontfn[i], out, 1);
+        roundtrip(fontfn[i], out, 9);
+#endif
+        free(out);
+        free(data);
+    }
+    printf("all fonts inflated correctly\n");
+    return 0;
+}
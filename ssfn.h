@@ -59,6 +59,7 @@ typedef unsigned long int   uint64_t;
 /* magic bytes */
 #define SSFN_MAGIC "SFN2"
 #define SSFN_COLLECTION "SFNC"
+#define SSFN_COLLIDX "SFNX"
 #define SSFN_ENDMAGIC "2NFS"
 
 /* ligatures area */
@@ -117,6 +118,24 @@ typedef struct {
     uint32_t    kerning_offs;           /* kerning table offset */
     uint32_t    cmap_offs;              /* color map offset */
 } _pack ssfn_font_t;
+
+/* optional font collection index, the last chunk in a collection */
+typedef struct {
+    uint8_t     magic[4];               /* SSFN collection index magic bytes */
+    uint32_t    size;                   /* size of the index in bytes, repeated in its last 4 bytes */
+    uint32_t    num;                    /* number of entries */
+} _pack ssfn_cidx_t;
+
+/* collection index entry, followed by the font's unique name, zero padded to 4 bytes */
+typedef struct {
+    uint32_t    offs;                   /* offset of the font from the collection's magic */
+    uint32_t    size;                   /* size of the font in the collection (compressed size if it's gzipped) */
+    uint8_t     cov[16];                /* code points with a glyph or starting a ligature, bit SSFN_COV_BIT */
+    ssfn_font_t hdr;                    /* copy of the font's header, followed by the name like in the font */
+} _pack ssfn_cent_t;
+
+/* coverage bit of a code point, one for each 1024 code points in the BMP, then one for each 16384 above it */
+#define SSFN_COV_BIT(u)         ((u) < 0x10000 ? (u) >> 10 : 64 + (((u) - 0x10000) >> 14))
 #ifdef _MSC_VER
 #pragma pack(pop)
 #endif
@@ -135,6 +154,20 @@ typedef struct {
 #define SSFN_STYLE_NOHINTING 1024       /* no auto hinting grid (not used as of now) */
 #define SSFN_STYLE_RTL       2048       /* render right-to-left */
 #define SSFN_STYLE_ABS_SIZE  4096       /* scale absoulte height */
+#define SSFN_STYLE_COVERAGE  8192       /* anti-aliasing with exact pixel coverage at target size */
+#define SSFN_STYLE_MASKCACHE 16384      /* also cache glyphs scaled to size as alpha masks */
+#define SSFN_STYLE_BUFFMT    32768      /* use the pixel format in ssfn_buf_t.f, otherwise the buffer is ARGB */
+#define SSFN_STYLE_SUBPIXEL  65536      /* fractional pen position, glyphs cached as masks for each phase */
+#define SSFN_STYLE_LCD      131072      /* LCD subpixel anti-aliasing (RGB stripes, BGR with negative buffer width) */
+
+/* destination pixel formats for the normal renderer, red and blue are swapped with negative buffer width */
+#define SSFN_FMT_ARGB           0       /* 32 bit 0xAARRGGBB pixels */
+#define SSFN_FMT_PARGB          1       /* same with premultiplied alpha (BGRA bytes on little endian) */
+#define SSFN_FMT_RGB565         2       /* 16 bit pixels, red in the most significant 5 bits */
+#define SSFN_FMT_BGR24          3       /* 24 bit pixels, blue, green and red bytes */
+#define SSFN_FMT_GRAY8          4       /* 8 bit grayscale */
+#define SSFN_FMT_A8             5       /* 8 bit alpha (coverage) mask, colors are ignored */
+#define SSFN_FMT_BPP(f) ((f) <= SSFN_FMT_PARGB ? 4 : ((f) == SSFN_FMT_RGB565 ? 2 : ((f) == SSFN_FMT_BGR24 ? 3 : 1)))
 
 /* error codes */
 #define SSFN_OK                 0       /* success */
@@ -149,6 +182,7 @@ typedef struct {
 #define SSFN_SIZE_MAX         192       /* biggest size we can render */
 #define SSFN_ITALIC_DIV         4       /* italic angle divisor, glyph top side pushed width / this pixels */
 #define SSFN_PREC               4       /* precision in bits */
+#define SSFN_SUBPIXEL           4       /* pen phases per pixel with SSFN_STYLE_SUBPIXEL (mask variants per glyph) */
 
 /* destination frame buffer context */
 typedef struct {
@@ -160,8 +194,25 @@ typedef struct {
     int16_t y;                          /* cursor y */
     uint32_t fg;                        /* foreground color */
     uint32_t bg;                        /* background color */
+    uint8_t f;                          /* pixel format, SSFN_FMT_x (normal renderer with SSFN_STYLE_BUFFMT only) */
+    uint8_t fx;                         /* cursor x fraction in 1/64 pixels (only with SSFN_STYLE_SUBPIXEL) */
 } ssfn_buf_t;
 
+/* a glyph's place in an atlas */
+typedef struct {
+    uint32_t unicode;                   /* code point */
+    uint16_t x, y, w, h;                /* rectangle in the atlas, zero sized if the glyph has no pixels */
+    int16_t l, t;                       /* rectangle's top left corner relative to the pen on the baseline */
+    int16_t ax, ay;                     /* advance */
+} ssfn_rect_t;
+
+/* glyph atlas, allocated in one block */
+typedef struct {
+    ssfn_buf_t buf;                     /* the atlas' pixels, its size and format */
+    int n;                              /* number of glyphs */
+    ssfn_rect_t *r;                     /* glyphs in the same order as in the string */
+} ssfn_atlas_t;
+
 /* cached bitmap struct */
 #define SSFN_DATA_MAX       ((SSFN_SIZE_MAX + 4 + (SSFN_SIZE_MAX + 4) / SSFN_ITALIC_DIV) << 8)
 typedef struct {
@@ -175,6 +226,37 @@ typedef struct {
     uint8_t data[SSFN_DATA_MAX];        /* data buffer */
 } ssfn_glyph_t;
 
+/* glyph cache entry, keyed by font, sketch height and synthetic style, followed by an ssfn_glyph_t of p * h + 8 bytes.
+ * Alpha masks are keyed by displayed height, and for fonts with a color map they have a color index plane after data */
+typedef struct ssfn_cache_s {
+    struct ssfn_cache_s *n;             /* next variant of the same code point */
+    struct ssfn_cache_s *lp, *ln;       /* previous (more recently used) and next (less recently used) entry */
+    const ssfn_font_t *f;               /* font the glyph was rasterized from */
+    uint32_t u;                         /* code point */
+    uint32_t s;                         /* synthetic style (SSFN_STYLE_BOLD, _ITALIC, _NOAA, _COVERAGE, _MASKCACHE) */
+} ssfn_cache_t;                         /* and for masks, the requested size, subpixel phase and LCD in the upper bits of s */
+#define SSFN_CACHE_GLYPH(e) ((ssfn_glyph_t*)((ssfn_cache_t*)(e) + 1))
+#define SSFN_CACHE_SIZE(p,h) ((int)sizeof(ssfn_cache_t) + 8 + (p) * (h))
+#define SSFN_CACHE_PLANES(e) (((e)->s & SSFN_STYLE_MASKCACHE) && (e)->f->cmap_offs ? 2 : 1)
+#ifdef SSFN_SHAREDCACHE
+/* contexts set up with ssfn_share() add glyphs to the cache of the context owning the fonts. Nothing can be evicted
+ * from there while other threads might be reading it, so it's only filled up to the budget */
+#define SSFN_CACHE_OWNER(c) ((c)->fs ? (ssfn_t*)(c)->fs : (c))
+#define SSFN_CACHE_FITS(c,s,k) (!SSFN_CACHE_OWNER(c)->cm || \
+    __atomic_load_n(&SSFN_CACHE_OWNER(c)->cs, __ATOMIC_RELAXED) + (s) <= SSFN_CACHE_OWNER(c)->cm)
+#else
+/* s bytes fit in the budget after evicting everything else but k bytes */
+#define SSFN_CACHE_FITS(c,s,k) (!(c)->cm || (s) + (k) <= (c)->cm)
+#endif
+#ifdef SSFN_CACHEARENA
+/* cached glyphs are allocated from blocks of SSFN_CACHEARENA bytes, so flushing the cache only frees the blocks. Evicted
+ * glyphs are reused by glyphs of the same size class, and the memory is only given back on flush */
+#ifdef SSFN_SHAREDCACHE
+#error "SSFN_CACHEARENA can't be used with SSFN_SHAREDCACHE"
+#endif
+#define SSFN_ARENA_HDR      16          /* block header, keeps the slots aligned */
+#endif
+
 /* character metrics */
 typedef struct {
     uint8_t t;                          /* type and overlap */
@@ -185,28 +267,124 @@ typedef struct {
     uint8_t y;                          /* advance y */
 } ssfn_chr_t;
 
-#ifdef SSFN_PROFILING
-#include <string.h>
-#include <sys/time.h>
+/* kerning pair, offsets in font grid units */
+typedef struct {
+    uint32_t l;                         /* code point on the left */
+    uint32_t r;                         /* code point on the right, 0 if slot is unused */
+    signed char x, y;                   /* kerning offsets */
+} ssfn_kern_t;
+
+/* per font lookup index, built on load (or on first use for mapped fonts) */
+typedef struct {
+    uint32_t **c;                       /* code point index, pages of 256 character offsets (0 if undefined) */
+    int nc;                             /* number of pages */
+    uint16_t *l;                        /* ligature index, 257 bucket starts by first byte, then ligatures, longest first */
+    int nl;                             /* number of ligatures */
+    ssfn_kern_t *k;                     /* kerning pair hash table, NULL if the font has no kerning */
+    int nk;                             /* number of slots, power of two */
+    const uint8_t *z;                   /* mapped font not used yet: its deflate stream, or the font itself */
+    const uint8_t *m;                   /* mapped font's coverage from the collection index, NULL if not known */
+} ssfn_idx_t;
+#define SSFN_KERN_HASH(l,r) ((((l) * 0x9E3779B1U) ^ ((r) * 0x85EBCA6BU)) >> 8)
+
+/* bytes inflated from a mapped font on load for its header and name, the rest is inflated on first use */
+#define SSFN_PEEK_MAX      1024
+
+#ifdef SSFN_STATICCACHE
+/* static glyph cache for SSFN_MAXLINES, glyphs are written one after another into a ring of SSFN_STATICCACHE bytes in
+ * the context, overwriting the oldest ones, and are found through a direct mapped index */
+#ifndef SSFN_STATICSLOTS
+#define SSFN_STATICSLOTS    (SSFN_STATICCACHE / 128 + 1)
+#endif
+typedef struct {
+    const ssfn_font_t *f;               /* font the glyph was rasterized from, NULL if the slot is unused */
+    uint32_t u;                         /* code point */
+    uint32_t s;                         /* synthetic style (SSFN_STYLE_BOLD, _ITALIC, _NOAA) and sketch height << 16 */
+    uint32_t o;                         /* position in the ring, valid until the ring is written over it */
+} ssfn_sslot_t;
+#define SSFN_STATIC_SLOT(u,s) ((((u) * 0x9E3779B1U) ^ (s)) % SSFN_STATICSLOTS)
 #endif
 
-/* renderer context */
+/* memoized font resolution */
+#define SSFN_RES_MAX        256
 typedef struct {
+    const ssfn_font_t *f;               /* resolved font, NULL if no font has the glyph */
+    ssfn_idx_t *fi;                     /* index of the resolved font */
+    uint8_t *c;                         /* character record in resolved font */
+    uint32_t u;                         /* code point */
+    uint8_t fm;                         /* requested family */
+    uint8_t st;                         /* requested style (bold and italic bits only) */
+    uint8_t sz;                         /* requested size */
+    uint8_t l;                          /* length of UTF-8 sequence, 0 if slot is unused */
+} ssfn_res_t;
+
+/* profiling counters, returned by ssfn_stats() when compiled with SSFN_PROFILING */
+#define SSFN_STAT_LOOKUP        0       /* character lookup and font fallback */
+#define SSFN_STAT_RASTER        1       /* rasterizing sketches and scaling them to masks */
+#define SSFN_STAT_BLIT          2       /* blitting to the pixel buffer */
+#define SSFN_STAT_KERN          3       /* advance and kerning */
+#define SSFN_STAT_BUCKETS      16       /* histogram buckets per stage */
+typedef struct {
+    uint64_t time[4];                   /* total time spent in each stage, in SSFN_CLOCK units (CPU ticks by default) */
+    uint32_t hist[4][SSFN_STAT_BUCKETS];/* times per stage, bucket 0 is below 128 units, bucket i is 64 << i to 128 << i */
+    uint32_t hits;                      /* glyphs found in the cache */
+    uint32_t misses;                    /* glyphs rasterized (hits + misses is the number of glyphs) */
+    uint32_t probes;                    /* fonts searched for a code point, more than one per glyph means fallback */
+    uint32_t memo;                      /* lookups answered by the resolution memo without searching */
+    uint64_t sketch;                    /* bytes of sketches allocated in the cache */
+    uint64_t mask;                      /* bytes of glyphs scaled to displayed size allocated in the cache */
+} ssfn_stats_t;
+
+#if defined(SSFN_PROFILING) && !defined(SSFN_CLOCK)
+# if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+# elif !defined(__GNUC__) || !(defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#  include <time.h>
+#  include <sys/time.h>
+# endif
+#endif
+
+/* renderer context */
+typedef struct ssfn_s {
 #ifdef SSFN_MAXLINES
     const ssfn_font_t *fnt[5][16];      /* static font registry */
 #else
     const ssfn_font_t **fnt[5];         /* dynamic font registry */
+    ssfn_idx_t **idx[5];                /* lookup indices for the fonts in registry */
+    const struct ssfn_s *fs;            /* context owning the registry if it's shared, NULL if it's our own */
 #endif
     const ssfn_font_t *s;               /* explicitly selected font */
     const ssfn_font_t *f;               /* font selected by best match */
+    ssfn_idx_t *si;                     /* index of the explicitly selected font */
+    ssfn_idx_t *fi;                     /* index of the best match font */
     ssfn_glyph_t ga;                    /* glyph sketch area */
     ssfn_glyph_t *g;                    /* current glyph pointer */
 #ifdef SSFN_MAXLINES
     uint16_t p[SSFN_MAXLINES*2];
+    uint16_t e[SSFN_MAXLINES];
+#ifdef SSFN_STATICCACHE
+    ssfn_sslot_t ss[SSFN_STATICSLOTS];  /* static glyph cache index */
+    uint32_t sw;                        /* static glyph cache write position */
+    uint8_t sc[SSFN_STATICCACHE];       /* static glyph cache ring */
+#endif
 #else
-    ssfn_glyph_t ***c[17];              /* glyph cache */
+    ssfn_cache_t ***c[17];              /* glyph cache */
+    ssfn_cache_t *lh, *lt;              /* most and least recently used glyph cache entry */
+    int cs, cm;                         /* glyph cache size and budget in bytes (0 unlimited) */
+    ssfn_res_t *r;                      /* font resolution cache */
+    uint8_t lb[32];                     /* bitmap of first bytes of ligatures in any loaded font */
     uint16_t *p;
+    uint16_t *e;                        /* edge table, ap / 2 entries */
+    int *ca, nca;                       /* coverage accumulator */
     char **bufs;                        /* allocated extra buffers */
+    void *(*ma)(void *data, void *ptr, int size);   /* allocator (like realloc), NULL for SSFN_realloc */
+    void (*mf)(void *data, void *ptr);  /* deallocator, NULL for SSFN_free */
+    void *md;                           /* allocator's data */
+#ifdef SSFN_CACHEARENA
+    char *ab;                           /* glyph cache arena blocks, each starts with a pointer to the next one */
+    int an, at;                         /* bytes in arena blocks, bytes free at the end of the first one */
+    void *al[64];                       /* freed arena slots by size class */
+#endif
 #endif
     ssfn_chr_t *rc;                     /* pointer to current character */
     int numbuf, lenbuf, np, ap, ox, oy, ax;
@@ -217,7 +395,7 @@ typedef struct {
     int size;                           /* required size */
     int line;                           /* calculate line height */
 #ifdef SSFN_PROFILING
-    uint64_t lookup, raster, blit, kern;/* profiling accumulators */
+    ssfn_stats_t st;                    /* profiling counters */
 #endif
 } ssfn_t;
 
@@ -227,11 +405,20 @@ uint32_t ssfn_utf8(char **str);
 
 /* normal renderer */
 int ssfn_load(ssfn_t *ctx, const void *data);                                       /* add an SSFN to context */
+int ssfn_map(ssfn_t *ctx, const void *data);                                        /* add an SSFN, read on first use */
+int ssfn_share(ssfn_t *ctx, const ssfn_t *fonts);                                   /* use fonts of another context */
 int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size);    /* select font to use */
 int ssfn_render(ssfn_t *ctx, ssfn_buf_t *dst, const char *str);                     /* render a glyph to a pixel buffer */
 int ssfn_bbox(ssfn_t *ctx, const char *str, int *w, int *h, int *left, int *top);   /* get bounding box */
 ssfn_buf_t *ssfn_text(ssfn_t *ctx, const char *str, unsigned int fg);               /* renders text to a newly allocated buffer */
+ssfn_atlas_t *ssfn_atlas(ssfn_t *ctx, const char *str, unsigned int fg, int fmt, int w); /* renders glyphs into an atlas */
+int ssfn_preload(ssfn_t *ctx, uint32_t first, uint32_t last);                       /* rasterize glyphs into the cache */
 int ssfn_mem(ssfn_t *ctx);                                                          /* return how much memory is used */
+void ssfn_flush(ssfn_t *ctx);                                                       /* flush the glyph cache */
+void ssfn_cachesize(ssfn_t *ctx, int size);                                         /* set glyph cache budget */
+int ssfn_allocator(ssfn_t *ctx, void *(*alloc)(void *data, void *ptr, int size),
+    void (*release)(void *data, void *ptr), void *data);                            /* use another allocator */
+int ssfn_stats(ssfn_t *ctx, ssfn_stats_t *stats, int reset);                        /* query profiling counters */
 void ssfn_free(ssfn_t *ctx);                                                        /* free context */
 #define ssfn_error(err) (err<0&&err>=-7?ssfn_errstr[-err]:"Unknown error")          /* return string for error code */
 extern const char *ssfn_errstr[];
@@ -298,6 +485,7 @@ uint32_t ssfn_utf8(char **s)
 #ifndef _STRING_H_
 extern int memcmp (const void *__s1, const void *__s2, size_t __n) __THROW;
 extern void *memset (void *__s, int __c, size_t __n) __THROW;
+extern void *memcpy (void *__dest, const void *__src, size_t __n) __THROW;
 #endif
 
 /* Clang does not have built-ins */
@@ -348,39 +536,147 @@ static void *SSFN_memset(void *__s, int __c, size_t __n)
 #   endif
 #  endif
 
+#  ifndef SSFN_memcpy
+#   ifdef __builtin_memcpy
+#    define SSFN_memcpy __builtin_memcpy
+#   else
+#    define SSFN_memcpy memcpy
+#   endif
+#  endif
+
 # endif /* if !SSFN_MAXLINES */
 
 /*** Private functions ***/
 
+#ifdef SSFN_PROFILING
+#define SSFN_PROF(x) ((void)(x))
+#ifndef SSFN_CLOCK
+/* the CPU's time stamp counter, or a monotonic clock in nanoseconds where there's none that needs no feature macros.
+ * Define SSFN_CLOCK to use something else */
+static uint64_t _ssfn_clk(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return (uint64_t)__builtin_ia32_rdtsc();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return (uint64_t)__rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t t;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (t));
+    return t;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000UL + (uint64_t)t.tv_nsec;
+#else
+    /* strict ANSI builds don't have it without _POSIX_C_SOURCE, last resort is the wall clock */
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (uint64_t)t.tv_sec * 1000000000UL + (uint64_t)t.tv_usec * 1000UL;
+#endif
+}
+#define SSFN_CLOCK _ssfn_clk
+#endif
+
+/* add the time since *t to a stage's total and histogram, and start measuring the next stage */
+static void _ssfn_pt(ssfn_t *ctx, int stage, uint64_t *t)
+{
+    uint64_t n = SSFN_CLOCK(), d = n - *t;
+    int b;
+    ctx->st.time[stage] += d;
+    for(d >>= 7, b = 0; d && b < SSFN_STAT_BUCKETS - 1; d >>= 1, b++);
+    ctx->st.hist[stage][b]++;
+    *t = n;
+}
+#else
+#define SSFN_PROF(x) ((void)0)
+#endif
+
+#ifdef SSFN_MAXLINES
+static ssfn_idx_t *_ssfn_noidx[16];
+#ifdef SSFN_STATICCACHE
+/* look up a glyph in the static cache, NULL if it's not there or it was overwritten since */
+static ssfn_glyph_t *_ssfn_sc(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int h)
+{
+    ssfn_sslot_t *sl = &ctx->ss[SSFN_STATIC_SLOT(unicode, ck | (h << 16))];
+    return sl->f == ctx->f && sl->u == unicode && sl->s == (ck | (h << 16)) && ctx->sw - sl->o <= SSFN_STATICCACHE ?
+        (ssfn_glyph_t*)(ctx->sc + sl->o % SSFN_STATICCACHE) : NULL;
+}
+
+/* add a glyph with p * h bytes of data to the static cache over the oldest ones, NULL if it's bigger than the cache */
+static ssfn_glyph_t *_ssfn_sa(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int p, int h)
+{
+    ssfn_sslot_t *sl = &ctx->ss[SSFN_STATIC_SLOT(unicode, ck | (h << 16))];
+    uint32_t s = (8 + p * h + 3) & ~3U, o;
+    if(s > SSFN_STATICCACHE) return NULL;
+    /* start over well before the position overflows, so that it maps to the ring the same way */
+    if(ctx->sw > 0x7FFFFFFFU) { SSFN_memset(ctx->ss, 0, sizeof(ctx->ss)); ctx->sw = 0; }
+    /* glyphs don't wrap around, the end of the ring is skipped if it doesn't fit there */
+    o = ctx->sw % SSFN_STATICCACHE;
+    if(o + s > SSFN_STATICCACHE) ctx->sw += SSFN_STATICCACHE - o;
+    sl->f = ctx->f; sl->u = unicode; sl->s = ck | (h << 16); sl->o = ctx->sw;
+    ctx->sw += s;
+    return (ssfn_glyph_t*)(ctx->sc + sl->o % SSFN_STATICCACHE);
+}
+#endif
+#else
+/* allocate or resize with the context's allocator */
+static void *_ssfn_ma(const ssfn_t *ctx, void *ptr, int size)
+{
+    return ctx && ctx->ma ? ctx->ma(ctx->md, ptr, size) : SSFN_realloc(ptr, size);
+}
+
+/* free with the context's allocator */
+static void _ssfn_mf(const ssfn_t *ctx, void *ptr)
+{
+    if(ctx && ctx->mf) ctx->mf(ctx->md, ptr); else SSFN_free(ptr);
+}
+#endif
+
+/* decode an UTF-8 sequence, don't use ssfn_utf8 to workaround -O2 bug in gcc 11.1 */
+static uint32_t _ssfn_u(const uint8_t *s, int *len)
+{
+    uint32_t u = *s;
+    *len = 1;
+    if((*s & 128) != 0) {
+        if(!(*s & 32)) { u = ((*s & 0x1F)<<6)|(*(s+1) & 0x3F); *len = 2; } else
+        if(!(*s & 16)) { u = ((*s & 0xF)<<12)|((*(s+1) & 0x3F)<<6)|(*(s+2) & 0x3F); *len = 3; } else
+        if(!(*s & 8)) { u = ((*s & 0x7)<<18)|((*(s+1) & 0x3F)<<12)|((*(s+2) & 0x3F)<<6)|(*(s+3) & 0x3F); *len = 4; }
+        else u = 0;
+    }
+    return u;
+}
+
 /* parse character table */
-static uint8_t *_ssfn_c(const ssfn_font_t *font, const char *str, int *len, uint32_t *unicode)
+static uint8_t *_ssfn_c(const ssfn_font_t *font, const ssfn_idx_t *idx, const char *str, int *len, uint32_t *unicode)
 {
     uint32_t i, j, u = -1U;
     uint16_t *l;
-    uint8_t *ptr, *s;
+    uint8_t *ptr, *s, *e = NULL;
 
     *len = 0; *unicode = 0;
     if(!font || !font->characters_offs || !str || !*str) return NULL;
 
-    if(font->ligature_offs) {
-        for(l = (uint16_t*)((uint8_t*)font + font->ligature_offs), i = 0; l[i] && u == -1U; i++) {
+    l = (uint16_t*)((uint8_t*)font + font->ligature_offs);
+    if(idx) {
+        /* ligatures in the bucket are ordered by length, so the first match is the longest */
+        if(idx->l)
+            for(i = idx->l[*(uint8_t*)str]; i < idx->l[*(uint8_t*)str + 1]; i++) {
+                j = idx->l[257 + i];
+                for(ptr = (uint8_t*)font + l[j], s = (uint8_t*)str; *ptr && *ptr == *s; ptr++, s++);
+                if(!*ptr) { u = SSFN_LIG_FIRST + j; e = s; break; }
+            }
+    } else if(font->ligature_offs) {
+        for(i = 0; l[i] && l[i] < font->size; i++) {
             for(ptr = (uint8_t*)font + l[i], s = (uint8_t*)str; *ptr && *ptr == *s; ptr++, s++);
-            if(!*ptr) { u = SSFN_LIG_FIRST + i; break; }
-        }
-    }
-    if(u == -1U) {
-        /* inline ssfn_utf8 to workaround -O2 bug in gcc 11.1 */
-        s = (uint8_t*)str; u = *s;
-        if((*s & 128) != 0) {
-            if(!(*s & 32)) { u = ((*s & 0x1F)<<6)|(*(s+1) & 0x3F); s++; } else
-            if(!(*s & 16)) { u = ((*s & 0xF)<<12)|((*(s+1) & 0x3F)<<6)|(*(s+2) & 0x3F); s += 2; } else
-            if(!(*s & 8)) { u = ((*s & 0x7)<<18)|((*(s+1) & 0x3F)<<12)|((*(s+2) & 0x3F)<<6)|(*(s+3) & 0x3F); s += 3; }
-            else u = 0;
+            if(!*ptr && s > (uint8_t*)str && s > e) { u = SSFN_LIG_FIRST + i; e = s; }
         }
-        s++;
     }
-    *len = (int)(s - (uint8_t*)str);
+    if(e) *len = (int)(e - (uint8_t*)str);
+    else u = _ssfn_u((uint8_t*)str, len);
     *unicode = u;
+    if(idx)
+        return (u >> 8) < (uint32_t)idx->nc && idx->c[u >> 8] && idx->c[u >> 8][u & 0xFF] ?
+            (uint8_t*)font + idx->c[u >> 8][u & 0xFF] : NULL;
     for(ptr = (uint8_t*)font + font->characters_offs, i = 0; i < 0x110000; i++) {
         if(ptr[0] == 0xFF) { i += 65535; ptr++; }
         else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
@@ -402,10 +698,12 @@ static void _ssfn_l(ssfn_t *ctx, int p, int h, int x, int y)
 #ifdef SSFN_MAXLINES
     if(ctx->np >= SSFN_MAXLINES*2-2) return;
 #else
-    if(ctx->ap <= ctx->np) {
+    /* keep room for the closing point too */
+    if(ctx->ap <= ctx->np + 4) {
         ctx->ap = ctx->np + 512;
-        ctx->p = (uint16_t*)SSFN_realloc(ctx->p, ctx->ap * sizeof(uint16_t));
-        if(!ctx->p) { ctx->ap = ctx->np = 0; return; }
+        ctx->p = (uint16_t*)_ssfn_ma(ctx, ctx->p, ctx->ap * sizeof(uint16_t));
+        ctx->e = (uint16_t*)_ssfn_ma(ctx, ctx->e, (ctx->ap >> 1) * sizeof(uint16_t));
+        if(!ctx->p || !ctx->e) { ctx->ap = ctx->np = 0; return; }
     }
 #endif
     if(!ctx->np) {
@@ -436,9 +734,201 @@ static void _ssfn_b(ssfn_t *ctx, int p,int h, int x0,int y0, int x1,int y1, int
     if(l) _ssfn_l(ctx, p,h, x3, y3);
 }
 
+#define SSFN_EDGE_TOP(p,e) ((p)[((e)<<1)+1] < (p)[((e)<<1)+3] ? (p)[((e)<<1)+1] : (p)[((e)<<1)+3])
+#define SSFN_EDGE_BTM(p,e) ((p)[((e)<<1)+1] > (p)[((e)<<1)+3] ? (p)[((e)<<1)+1] : (p)[((e)<<1)+3])
+
+/* collect the non-horizontal edges of a polyline into e, sorted by their top, returns number of edges */
+static int _ssfn_es(const uint16_t *p, int np, uint16_t *e)
+{
+    int i, j, k, n, t, y;
+    for(n = i = 0; i < np - 3 && i < 131070; i += 2)
+        if(p[i + 1] != p[i + 3]) e[n++] = i >> 1;
+    for(k = n >> 1; k > 0; k >>= 1)
+        for(i = k; i < n; i++) {
+            t = e[i]; y = SSFN_EDGE_TOP(p, t);
+            for(j = i; j >= k && SSFN_EDGE_TOP(p, e[j - k]) > y; j -= k) e[j] = e[j - k];
+            e[j] = t;
+        }
+    return n;
+}
+
+/**
+ * Update the active edge table for scanline b, and return the number of crossings. Active edges are kept
+ * in e[0 .. *na], with their crossings in r in ascending order. Edges in e[*ni .. ne] are not reached yet.
+ */
+static int _ssfn_ae(const uint16_t *p, uint16_t *e, int ne, int *na, int *ni, int b, uint16_t *r, int rn)
+{
+    int a = b << SSFN_PREC, i, j, n, t, x;
+    const uint16_t *q;
+    for(i = n = 0; i < *na; i++)
+        if(SSFN_EDGE_BTM(p, e[i]) >= a) e[n++] = e[i];
+    for(; *ni < ne && SSFN_EDGE_TOP(p, e[*ni]) < a; (*ni)++)
+        if(SSFN_EDGE_BTM(p, e[*ni]) >= a) e[n++] = e[*ni];
+    *na = n;
+    /* edges are still in order of the previous scanline's crossings, so this insertion sort is mostly linear */
+    for(i = 0; i < n && i < rn; i++) {
+        t = e[i]; q = p + (t << 1);
+        if((q[1] >> SSFN_PREC) == (q[3] >> SSFN_PREC))
+            x = (((int)q[0] + (int)q[2]) >> 1);
+        else
+            x = ((int)q[0]) + ((a - (int)q[1]) * ((int)q[2] - (int)q[0]) / ((int)q[3] - (int)q[1]));
+        x >>= SSFN_PREC;
+        for(j = i; j > 0 && r[j - 1] > x; j--) { r[j] = r[j - 1]; e[j] = e[j - 1]; }
+        r[j] = x; e[j] = t;
+    }
+    return i;
+}
+
+/**
+ * Count background (0xFF) and foreground (0xFE, only if nf isn't NULL) sketch pixels in a run of n bytes
+ */
+static void _ssfn_bn(const uint8_t *d, int n, int *nb, int *nf)
+{
+    if(nf) {
+        for(; n > 0; n--, d++)
+            if(*d == 0xFF) (*nb)++; else if(*d == 0xFE) (*nf)++;
+    } else
+        for(; n > 0; n--, d++)
+            *nb += *d == 0xFF;
+}
+
+/**
+ * Box filter the sketch area x0,y0 - x1,y1 (in 1/256 sketch pixels) for opaque foreground. Returns the sum of weights
+ * in m, the sum of background weights in pb and the number of background samples in nb. Same as the generic loop in
+ * ssfn_render(), except that full weight samples are counted in runs. Returns 0 if there are palette colors (with cm).
+ */
+static int _ssfn_bx(ssfn_glyph_t *g, int cm, int x0, int x1, int y0, int y1, int *m, int *pb, int *nb)
+{
+    int X0 = x0 >> 8, X1 = x1 >> 8, Y0 = y0 >> 8, Y1 = y1 >> 8, xs, ys, yp, k, pc, n, b, f;
+    uint8_t *d;
+    for(ys = y0; ys < y1; ys += 256) {
+        if(ys >> 8 == Y0) { yp = 256 - (ys & 0xFF); ys &= ~0xFF; if(yp > y1 - y0) yp = y1 - y0; }
+        else if(ys >> 8 == Y1) yp = y1 & 0xFF; else yp = 256;
+        d = g->data + (ys >> 8) * g->p;
+        for(xs = x0; xs < x1; xs += 256) {
+            if(xs >> 8 == X0) {
+                k = 256 - (xs & 0xFF); xs &= ~0xFF; if(k > x1 - x0) k = x1 - x0; pc = (k * yp) >> 8;
+            } else
+            if(xs >> 8 == X1) { k = x1 & 0xFF; pc = (k * yp) >> 8; }
+            else {
+                /* all columns up to X1 have full weight */
+                n = X1 - (xs >> 8); b = f = 0;
+                _ssfn_bn(d + (xs >> 8), n, &b, cm ? &f : NULL);
+                if(cm && b + f != n) return 0;
+                *m += n * yp; *pb += b * yp; *nb += b;
+                xs += (n - 1) << 8;
+                continue;
+            }
+            *m += pc;
+            k = d[xs >> 8];
+            if(k == 0xFF) { *pb += pc; (*nb)++; }
+            else if(cm && k != 0xFE) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Read the destination pixel at o in format f as 0xAARRGGBB (alpha is 255 for formats without it), swap red and blue if cs
+ */
+inline static uint32_t _ssfn_pg(uint8_t *o, int f, int cs)
+{
+    uint32_t c;
+    /* real linear frame buffers should be accessed only as uint32_t on 32 bit boundary */
+    if(f <= SSFN_FMT_PARGB) c = *((uint32_t*)o);
+    else switch(f) {
+        case SSFN_FMT_RGB565:
+            c = *((uint16_t*)o);
+            c = 0xFF000000 | ((c & 0xF800) << 8) | ((c & 0xE000) << 3) | ((c & 0x7E0) << 5) | ((c & 0x600) >> 1) |
+                ((c & 0x1F) << 3) | ((c & 0x1C) >> 2);
+        break;
+        case SSFN_FMT_BGR24: c = 0xFF000000 | ((uint32_t)o[2] << 16) | ((uint32_t)o[1] << 8) | o[0]; break;
+        case SSFN_FMT_GRAY8: return 0xFF000000 | ((uint32_t)o[0] * 0x010101);
+        default: return (uint32_t)o[0] << 24;
+    }
+    return cs ? (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16) : c;
+}
+
+/**
+ * Write color c (0xAARRGGBB) to the destination pixel at o in format f, swap red and blue if cs. ARGB pixels get the
+ * alpha as is, but premultiplied and alpha only pixels are composited, their alpha becomes c's alpha over the old one
+ */
+inline static void _ssfn_pp(uint8_t *o, int f, int cs, uint32_t c)
+{
+    uint32_t a = c >> 24;
+    if(cs && f != SSFN_FMT_GRAY8) c = (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
+    if(f == SSFN_FMT_ARGB) *((uint32_t*)o) = c;
+    else switch(f) {
+        case SSFN_FMT_PARGB:
+            a += (*((uint32_t*)o) >> 24) * (255 - a) / 255;
+            *((uint32_t*)o) = (a << 24) | (c & 0xFFFFFF);
+        break;
+        case SSFN_FMT_RGB565: *((uint16_t*)o) = ((c >> 8) & 0xF800) | ((c >> 5) & 0x7E0) | ((c >> 3) & 0x1F); break;
+        case SSFN_FMT_BGR24: o[0] = c & 0xFF; o[1] = (c >> 8) & 0xFF; o[2] = (c >> 16) & 0xFF; break;
+        case SSFN_FMT_GRAY8: o[0] = (((c >> 16) & 0xFF) * 77 + ((c >> 8) & 0xFF) * 150 + (c & 0xFF) * 29) >> 8; break;
+        default: o[0] = a + o[0] * (255 - a) / 255; break;
+    }
+}
+
 #ifndef SSFN_MAXLINES
+#ifdef SSFN_CACHEARENA
+/* size class of an arena slot, 4 classes for every power of two from 64 bytes on, the slot's size is returned in s */
+static int _ssfn_ak(int size, int *s)
+{
+    int k;
+    for(k = 0, *s = 64; *s < size; k++, *s = (4 + (k & 3)) << (4 + (k >> 2)));
+    return k;
+}
+
+/* allocate a slot from the glyph cache arena, a freed one of the same size class if there's any */
+static void *_ssfn_aa(ssfn_t *ctx, int size)
+{
+    char *b;
+    int s, n, k = _ssfn_ak(size, &s);
+    if(k >= (int)(sizeof(ctx->al) / sizeof(ctx->al[0]))) return NULL;
+    if((b = (char*)ctx->al[k])) { ctx->al[k] = *((void**)b); return b; }
+    if(s > ctx->at) {
+        /* slots bigger than a block get a block of their own behind the first one, which is still being filled */
+        n = s > SSFN_CACHEARENA - SSFN_ARENA_HDR ? s + SSFN_ARENA_HDR : SSFN_CACHEARENA;
+        if(!(b = (char*)_ssfn_ma(ctx, NULL, n))) return NULL;
+        ctx->an += n;
+        if(n != SSFN_CACHEARENA) {
+            if(ctx->ab) { *((char**)b) = *((char**)ctx->ab); *((char**)ctx->ab) = b; }
+            else { *((char**)b) = NULL; ctx->ab = b; ctx->at = 0; }
+            return b + SSFN_ARENA_HDR;
+        }
+        *((char**)b) = ctx->ab; ctx->ab = b; ctx->at = SSFN_CACHEARENA - SSFN_ARENA_HDR;
+    }
+    b = ctx->ab + SSFN_CACHEARENA - ctx->at; ctx->at -= s;
+    return b;
+}
+
+/* give a slot back to the arena */
+static void _ssfn_ar(ssfn_t *ctx, void *ptr, int size)
+{
+    int s, k = _ssfn_ak(size, &s);
+    *((void**)ptr) = ctx->al[k]; ctx->al[k] = ptr;
+}
+#define SSFN_CACHE_ALLOC(c,s) _ssfn_aa(c,s)
+#define SSFN_CACHE_FREE(c,p,s) _ssfn_ar(c,p,s)
+#else
+#define SSFN_CACHE_ALLOC(c,s) _ssfn_ma(c,NULL,s)
+#define SSFN_CACHE_FREE(c,p,s) _ssfn_mf(c,p)
+#endif
+
+/* free the glyph cache */
 static void _ssfn_fc(ssfn_t *ctx)
 {
+#ifdef SSFN_CACHEARENA
+    char *b;
+    if(!ctx) return;
+    /* glyphs and page tables are all in the arena, no need to walk through them */
+    while((b = ctx->ab)) { ctx->ab = *((char**)b); _ssfn_mf(ctx, b); }
+    ctx->an = ctx->at = 0;
+    SSFN_memset(ctx->al, 0, sizeof(ctx->al));
+    SSFN_memset(ctx->c, 0, sizeof(ctx->c));
+#else
+    ssfn_cache_t *e, *n;
     int i, j, k;
     if(!ctx) return;
     for(k = 0; k <= 16; k++)
@@ -446,19 +936,492 @@ static void _ssfn_fc(ssfn_t *ctx)
             for(j = 0; j < 256; j++)
                 if(ctx->c[k][j]) {
                     for(i = 0; i < 256; i++)
-                        if(ctx->c[k][j][i]) SSFN_free(ctx->c[k][j][i]);
-                    SSFN_free(ctx->c[k][j]);
+                        for(e = ctx->c[k][j][i]; e; e = n) { n = e->n; _ssfn_mf(ctx, e); }
+                    _ssfn_mf(ctx, ctx->c[k][j]);
                 }
-            SSFN_free(ctx->c[k]);
+            _ssfn_mf(ctx, ctx->c[k]);
             ctx->c[k] = NULL;
         }
+#endif
+    ctx->lh = ctx->lt = NULL;
+    ctx->cs = 0;
+}
+
+#ifdef SSFN_SHAREDCACHE
+/* get the cache slot of a code point, allocating the page tables if asked to. Readers don't lock, so tables are never
+ * freed while in use, they are added with compare and swap, and if another thread was faster, we use its table */
+static ssfn_cache_t **_ssfn_gs(ssfn_t *cc, uint32_t unicode, int alloc)
+{
+    ssfn_cache_t ***t, ***ot, **s, **os;
+    if(!(t = __atomic_load_n(&cc->c[unicode >> 16], __ATOMIC_ACQUIRE))) {
+        if(!alloc || !(t = (ssfn_cache_t***)_ssfn_ma(cc, NULL, 256 * sizeof(void*)))) return NULL;
+        SSFN_memset(t, 0, 256 * sizeof(void*)); ot = NULL;
+        if(!__atomic_compare_exchange_n(&cc->c[unicode >> 16], &ot, t, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            _ssfn_mf(cc, t); t = ot;
+        }
+    }
+    if(!(s = __atomic_load_n(&t[(unicode >> 8) & 0xFF], __ATOMIC_ACQUIRE))) {
+        if(!alloc || !(s = (ssfn_cache_t**)_ssfn_ma(cc, NULL, 256 * sizeof(void*)))) return NULL;
+        SSFN_memset(s, 0, 256 * sizeof(void*)); os = NULL;
+        if(!__atomic_compare_exchange_n(&t[(unicode >> 8) & 0xFF], &os, s, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            _ssfn_mf(cc, s); s = os;
+        }
+    }
+    return &s[unicode & 0xFF];
+}
+
+/* free a glyph which was not added to the cache yet */
+static void _ssfn_gr(ssfn_t *ctx, ssfn_cache_t *e)
+{
+    _ssfn_mf(SSFN_CACHE_OWNER(ctx), e);
+}
+
+/* look up a glyph in the cache of the context owning the fonts, NULL if it's not cached. Entries are never modified
+ * nor freed once added, so there's no locking and no recently used list */
+static ssfn_glyph_t *_ssfn_gc(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int h)
+{
+    ssfn_cache_t **s = _ssfn_gs(SSFN_CACHE_OWNER(ctx), unicode, 0), *ce;
+    for(ce = s ? __atomic_load_n(s, __ATOMIC_ACQUIRE) : NULL; ce; ce = ce->n)
+        if(ce->f == ctx->f && ce->s == ck && SSFN_CACHE_GLYPH(ce)->h == h)
+            return SSFN_CACHE_GLYPH(ce);
+    return NULL;
+}
+
+/* allocate a glyph with p * h bytes of data, only visible to other threads once _ssfn_gp() adds it to the cache */
+static ssfn_glyph_t *_ssfn_ga(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int p, int h)
+{
+    ssfn_cache_t *ce;
+    /* allocate the page tables now, so that adding the glyph later can't fail */
+    if(!_ssfn_gs(SSFN_CACHE_OWNER(ctx), unicode, 1)) return NULL;
+    ce = (ssfn_cache_t*)_ssfn_ma(SSFN_CACHE_OWNER(ctx), NULL, sizeof(ssfn_cache_t) + p * h + 8);
+    if(!ce) return NULL;
+    ce->f = ctx->f; ce->s = ck; ce->u = unicode;
+    ce->n = ce->lp = ce->ln = NULL;
+    return SSFN_CACHE_GLYPH(ce);
+}
+
+/* add a filled in glyph to the cache, other threads might be adding to the same slot at the same time */
+static void _ssfn_gp(ssfn_t *ctx, ssfn_glyph_t *g)
+{
+    ssfn_t *cc = SSFN_CACHE_OWNER(ctx);
+    ssfn_cache_t *ce = (ssfn_cache_t*)g - 1, **s = _ssfn_gs(cc, ce->u, 0);
+    ce->n = __atomic_load_n(s, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(s, &ce->n, ce, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&cc->cs, SSFN_CACHE_SIZE(g->p, g->h * SSFN_CACHE_PLANES(ce)), __ATOMIC_RELAXED);
+}
+#else
+/* unlink a glyph cache entry from the recently used list */
+static void _ssfn_lu(ssfn_t *ctx, ssfn_cache_t *e)
+{
+    if(e->lp) e->lp->ln = e->ln; else ctx->lh = e->ln;
+    if(e->ln) e->ln->lp = e->lp; else ctx->lt = e->lp;
+}
+
+/* remove an entry from the glyph cache */
+static void _ssfn_gr(ssfn_t *ctx, ssfn_cache_t *e)
+{
+    ssfn_cache_t **n;
+    _ssfn_lu(ctx, e);
+    for(n = &ctx->c[e->u >> 16][(e->u >> 8) & 0xFF][e->u & 0xFF]; *n != e; n = &(*n)->n);
+    *n = e->n;
+    ctx->cs -= SSFN_CACHE_SIZE(SSFN_CACHE_GLYPH(e)->p, SSFN_CACHE_GLYPH(e)->h * SSFN_CACHE_PLANES(e));
+    SSFN_CACHE_FREE(ctx, e, SSFN_CACHE_SIZE(SSFN_CACHE_GLYPH(e)->p, SSFN_CACHE_GLYPH(e)->h * SSFN_CACHE_PLANES(e)));
+}
+
+/* evict least recently used glyphs until there's room for size bytes */
+static void _ssfn_ev(ssfn_t *ctx, int size)
+{
+    while(ctx->lt && ctx->cs + size > ctx->cm)
+        _ssfn_gr(ctx, ctx->lt);
+}
+
+/* look up a glyph in the cache and make it the most recently used one, NULL if it's not cached */
+static ssfn_glyph_t *_ssfn_gc(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int h)
+{
+    ssfn_cache_t *ce;
+    if(!ctx->c[unicode >> 16] || !ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) return NULL;
+    for(ce = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF]; ce; ce = ce->n)
+        if(ce->f == ctx->f && ce->s == ck && SSFN_CACHE_GLYPH(ce)->h == h) {
+            if(ce->lp) { _ssfn_lu(ctx, ce); ce->lp = NULL; ce->ln = ctx->lh; ctx->lh->lp = ce; ctx->lh = ce; }
+            return SSFN_CACHE_GLYPH(ce);
+        }
+    return NULL;
+}
+
+/* add a glyph with p * h bytes of data to the cache, evicting old ones if needed, NULL on allocation error */
+static ssfn_glyph_t *_ssfn_ga(ssfn_t *ctx, uint32_t unicode, uint32_t ck, int p, int h)
+{
+    ssfn_cache_t *ce;
+#ifdef SSFN_CACHEARENA
+    /* evicted slots can only be reused by the same size class, so when the arena has grown to the budget, the whole
+     * cache goes at once. The sketch a mask is made of might be in there, that's moved to the sketch area first */
+    if(ctx->cm && ctx->an >= ctx->cm) {
+        if(ctx->g && ctx->g != &ctx->ga) {
+            SSFN_memcpy(&ctx->ga, ctx->g, 8 + ctx->g->p * ctx->g->h);
+            ctx->g = &ctx->ga;
+        }
+        _ssfn_fc(ctx);
+    }
+#endif
+    if(ctx->cm) _ssfn_ev(ctx, SSFN_CACHE_SIZE(p, h));
+    if(!ctx->c[unicode >> 16]) {
+        ctx->c[unicode >> 16] = (ssfn_cache_t***)SSFN_CACHE_ALLOC(ctx, 256 * sizeof(void*));
+        if(!ctx->c[unicode >> 16]) return NULL;
+        SSFN_memset(ctx->c[unicode >> 16], 0, 256 * sizeof(void*));
+    }
+    if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) {
+        ctx->c[unicode >> 16][(unicode >> 8) & 0xFF] = (ssfn_cache_t**)SSFN_CACHE_ALLOC(ctx, 256 * sizeof(void*));
+        if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) return NULL;
+        SSFN_memset(ctx->c[unicode >> 16][(unicode >> 8) & 0xFF], 0, 256 * sizeof(void*));
+    }
+    ce = (ssfn_cache_t*)SSFN_CACHE_ALLOC(ctx, sizeof(ssfn_cache_t) + p * h + 8);
+    if(!ce) return NULL;
+    ce->f = ctx->f; ce->s = ck; ce->u = unicode;
+    ce->n = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF];
+    ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF] = ce;
+    ce->lp = NULL; ce->ln = ctx->lh;
+    if(ctx->lh) ctx->lh->lp = ce; else ctx->lt = ce;
+    ctx->lh = ce;
+    ctx->cs += SSFN_CACHE_SIZE(p, h);
+    return SSFN_CACHE_GLYPH(ce);
+}
+#endif
+
+/* get the font resolution cache slot for a string, NULL if resolution can't be memoized. Also returns the code point
+ * and its encoded length, a slot is only valid for the same bytes, overlong encodings decode to the same code point */
+static ssfn_res_t *_ssfn_r(ssfn_t *ctx, const char *str, uint32_t *unicode, int *len)
+{
+    /* a ligature could match in any of the fonts, that depends on more than the code point */
+    if(ctx->lb[*(uint8_t*)str >> 3] & (1 << (*(uint8_t*)str & 7))) return NULL;
+    if(!ctx->r) {
+        ctx->r = (ssfn_res_t*)_ssfn_ma(ctx, NULL, SSFN_RES_MAX * sizeof(ssfn_res_t));
+        if(!ctx->r) return NULL;
+        SSFN_memset(ctx->r, 0, SSFN_RES_MAX * sizeof(ssfn_res_t));
+    }
+    *unicode = _ssfn_u((uint8_t*)str, len);
+    return &ctx->r[(*unicode ^ (*unicode >> 8)) & (SSFN_RES_MAX - 1)];
+}
+
+/**
+ * Add the signed area of the polyline's edges to the coverage accumulator. Coordinates are in 1/256 pixels, each edge
+ * adds its height within a row to the cells it crosses, split by how much of the cell is right to the edge. Summing a row
+ * from left to right then gives the winding number multiplied by the covered area for each pixel.
+ */
+static void _ssfn_ac(ssfn_t *ctx, int p, int h, int ci)
+{
+    int i, s, d, e, c, m, t, x0, y0, x1, y1, y, ya, yb, xa, xb, xl, xr, *a;
+    for(i = 0; i < ctx->np - 3; i += 2) {
+        y0 = ctx->p[i + 1] << 4; y1 = ctx->p[i + 3] << 4;
+        if(y0 == y1) continue;
+        x0 = (ctx->p[i] << 4) + (ci ? ((h << 8) - y0) / SSFN_ITALIC_DIV : 0);
+        x1 = (ctx->p[i + 2] << 4) + (ci ? ((h << 8) - y1) / SSFN_ITALIC_DIV : 0);
+        if(y0 < y1) s = 1; else { s = -1; m = x0; x0 = x1; x1 = m; m = y0; y0 = y1; y1 = m; }
+        for(y = y0 >> 8; y < h && (y << 8) < y1; y++) {
+            ya = y0 > (y << 8) ? y0 : y << 8; yb = y1 < ((y + 1) << 8) ? y1 : (y + 1) << 8;
+            /* all y values are multiples of 16, so this can't overflow */
+            xa = x0 + ((ya - y0) >> 4) * (x1 - x0) / ((y1 - y0) >> 4);
+            xb = x0 + ((yb - y0) >> 4) * (x1 - x0) / ((y1 - y0) >> 4);
+            if(xa > xb) { m = xa; xa = xb; xb = m; }
+            d = (yb - ya) * s; a = ctx->ca + y * (p + 2);
+            c = xa >> 8; e = xb > xa ? (xb - 1) >> 8 : c;
+            if(c == e) {
+                m = ((xa + xb) >> 1) - (c << 8);
+                a[c] += d * (256 - m); a[c + 1] += d * m;
+            } else
+                for(; c <= e; c++) {
+                    xl = xa > (c << 8) ? xa : c << 8; xr = xb < ((c + 1) << 8) ? xb : (c + 1) << 8;
+                    m = ((xl + xr) >> 1) - (c << 8);
+                    t = d * (xr - xa) / (xb - xa) - d * (xl - xa) / (xb - xa);
+                    a[c] += t * (256 - m); a[c + 1] += t * m;
+                }
+        }
+    }
+}
+
+/**
+ * Resolve the accumulated areas into coverage with the even-odd rule, and embolden horizontally by cw / 256 pixels
+ * on both sides (the sketch is scaled to the target size, so unlike the sketch's cb, this can be fractional).
+ */
+static void _ssfn_cr(ssfn_t *ctx, int p, int h, int cw)
+{
+    int i, j, k, s, v, *a;
+    uint8_t *d;
+    for(j = 0; j < h; j++) {
+        a = ctx->ca + j * (p + 2); d = ctx->g->data + j * p;
+        for(i = s = 0; i < p; i++) {
+            s += a[i]; v = (s < 0 ? -s : s) & 131071;
+            if(v > 65536) v = 131072 - v;
+            d[i] = v > 65279 ? 255 : v >> 8;
+        }
+        /* the accumulator row is not needed any more, so use it to keep the unemboldened coverage */
+        if(cw) {
+            for(i = 0; i < p; i++) a[i] = d[i];
+            for(i = 0; i < p; i++)
+                for(k = 1; k <= (cw >> 8) + 1; k++) {
+                    v = k <= (cw >> 8) ? 256 : cw & 0xFF;
+                    if(i >= k && (a[i - k] * v >> 8) > d[i]) d[i] = a[i - k] * v >> 8;
+                    if(i + k < p && (a[i + k] * v >> 8) > d[i]) d[i] = a[i + k] * v >> 8;
+                }
+        }
+        for(i = 0; i < p && !d[i]; i++);
+        if(i < p) ctx->g->d = j;
+    }
+}
+
+/**
+ * Scale the sketch down to a w x h alpha mask with the same box filter as ssfn_render() uses. If c isn't NULL, then the
+ * color index is also stored for each pixel (0xFE for foreground). Returns 0 if a pixel would mix different colors.
+ * With a subpixel phase f (in 1/256 pixels) the glyph is shifted right by that much, and the mask is wider by f rounded up.
+ */
+static int _ssfn_dm(ssfn_glyph_t *g, int w, int h, int f, uint8_t *d, uint8_t *c)
+{
+    int x, y, x0, x1, y0, y1, X0, X1, Y0, Y1, xs, ys, yp, pc, k, m, a, b, n, e;
+    for(y = 0; y < h; y++) {
+        y0 = (y << 8) * g->h / h; Y0 = y0 >> 8; y1 = ((y + 1) << 8) * g->h / h; Y1 = y1 >> 8;
+        for(x = 0; x < w + ((f + 255) >> 8); x++, d++) {
+            x0 = ((x << 8) - f) * g->p / w; x1 = (((x + 1) << 8) - f) * g->p / w; e = x1 - x0;
+            if(x0 < 0) x0 = 0;
+            if(x1 > g->p << 8) x1 = g->p << 8;
+            if(x0 >= x1) { *d = 0; if(c) *c++ = 0xFE; continue; }
+            X0 = x0 >> 8; X1 = x1 >> 8;
+            m = a = b = 0;
+            if(_ssfn_bx(g, c != NULL, x0, x1, y0, y1, &m, &a, &b)) {
+                if(c) *c++ = 0xFE;
+            } else {
+                /* there are palette colors in this area, only one color can be stored per pixel */
+                for(m = a = 0, n = -1, ys = y0; ys < y1; ys += 256) {
+                    if(ys >> 8 == Y0) { yp = 256 - (ys & 0xFF); ys &= ~0xFF; if(yp > y1 - y0) yp = y1 - y0; }
+                    else if(ys >> 8 == Y1) yp = y1 & 0xFF; else yp = 256;
+                    for(xs = x0; xs < x1; xs += 256) {
+                        if(xs >> 8 == X0) { k = 256 - (xs & 0xFF); xs &= ~0xFF; if(k > x1 - x0) k = x1 - x0; pc = (k * yp) >> 8; }
+                        else if(xs >> 8 == X1) pc = ((x1 & 0xFF) * yp) >> 8; else pc = yp;
+                        m += pc;
+                        k = g->data[(ys >> 8) * g->p + (xs >> 8)];
+                        if(k == 0xFF) a += pc; else
+                        if(n == -1) n = k; else
+                        if(n != k) return 0;
+                    }
+                }
+                *c++ = n == -1 ? 0xFE : n;
+            }
+            /* the part of the box that's outside of the sketch is background */
+            if(e > x1 - x0) { k = m * (e - x1 + x0) / (x1 - x0); m += k; a += k; }
+            *d = m ? (m - a) * 255 / m : 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Filter a w x h alpha mask sampled at 3x horizontal resolution (one sample per LCD stripe) in place with a 5-tap FIR to
+ * reduce color fringes. Lines become p samples long (at least w + 6), starting a pixel (3 samples) left of the mask.
+ * t is a temporary buffer of p + 5 bytes
+ */
+static void _ssfn_lf(uint8_t *d, int w, int h, int p, uint8_t *t)
+{
+    int x, y;
+    SSFN_memset(t, 0, p + 5);
+    for(y = h - 1; y >= 0; y--) {
+        for(x = 0; x < w; x++) t[x + 5] = d[y * w + x];
+        for(x = 0; x < p; x++)
+            d[y * p + x] = (8 * t[x] + 77 * t[x + 1] + 86 * t[x + 2] + 77 * t[x + 3] + 8 * t[x + 4]) >> 8;
+    }
+}
+
+/**
+ * Enlarge a zeroed pixel buffer to at least w x h, keeping its content in the top left corner. Grows at least twice
+ * as big in the direction that is too small, so that it's done only a few times while the pen moves
+ */
+static int _ssfn_tg(const ssfn_t *ctx, ssfn_buf_t *b, int w, int h)
+{
+    uint32_t *d;
+    int x, y;
+    if(w <= b->w && h <= b->h) return 1;
+    if(w <= b->w) w = b->w; else if(w < 2 * b->w) w = 2 * b->w;
+    if(h <= b->h) h = b->h; else if(h < 2 * b->h) h = 2 * b->h;
+    if(!(d = (uint32_t*)_ssfn_ma(ctx, NULL, w * h * sizeof(uint32_t)))) return 0;
+    SSFN_memset(d, 0, w * h * sizeof(uint32_t));
+    for(y = 0; b->ptr && y < b->h; y++)
+        for(x = 0; x < b->w; x++) d[y * w + x] = *((uint32_t*)(b->ptr + y * b->p) + x);
+    if(b->ptr) _ssfn_mf(ctx, b->ptr);
+    b->ptr = (uint8_t*)d; b->w = w; b->h = h; b->p = w * sizeof(uint32_t);
+    return 1;
+}
+
+/* free a code point index */
+static void _ssfn_fi(const ssfn_t *ctx, ssfn_idx_t *idx)
+{
+    int i;
+    if(!idx) return;
+    if(idx->c) {
+        for(i = 0; i < idx->nc; i++)
+            if(idx->c[i]) _ssfn_mf(ctx, idx->c[i]);
+        _ssfn_mf(ctx, idx->c);
+    }
+    if(idx->l) _ssfn_mf(ctx, idx->l);
+    if(idx->k) _ssfn_mf(ctx, idx->k);
+    _ssfn_mf(ctx, idx);
+}
+
+/* coverage of a mapped font that failed to load */
+static const uint8_t _ssfn_nocov[16] = { 0 };
+
+/* add the first bytes of a font's ligatures to the ligature bitmap */
+static void _ssfn_lg(ssfn_t *ctx, const ssfn_font_t *font, const ssfn_idx_t *idx)
+{
+    uint16_t *l;
+    int i;
+    if(idx) {
+        /* without a ligature index (not enough memory), ligatures aren't matched at all */
+        for(i = 0; idx->l && i < 256; i++)
+            if(idx->l[i] < idx->l[i + 1]) ctx->lb[i >> 3] |= 1 << (i & 7);
+    } else if(font->ligature_offs)
+        for(l = (uint16_t*)((uint8_t*)font + font->ligature_offs), i = 0; l[i] && l[i] < font->size; i++)
+            ctx->lb[*((uint8_t*)font + l[i]) >> 3] |= 1 << (*((uint8_t*)font + l[i]) & 7);
+}
+
+/**
+ * Walk the kerning groups of all characters. Returns the number of non-zero kerning offsets, and if the hash table is
+ * already allocated, adds them to it. For each pair, the first offset found in each direction is used.
+ */
+static int _ssfn_kp(const ssfn_font_t *font, ssfn_idx_t *idx)
+{
+    uint8_t *ptr, *frg, *tmp, *end = (uint8_t*)font + font->size - 4;
+    uint32_t i, m, P, e, s, g;
+    int n, k, x, v, ret = 0;
+    for(i = 0; i < (uint32_t)idx->nc << 8; i++) {
+        if(!idx->c[i >> 8] || !idx->c[i >> 8][i & 0xFF]) continue;
+        ptr = (uint8_t*)font + idx->c[i >> 8][i & 0xFF];
+        for(n = ptr[1], k = ptr[0] & 0x40 ? 6 : 5, ptr += sizeof(ssfn_chr_t); n > 0; n--, ptr += k) {
+            if(ptr[0] == 255 && ptr[1] == 255) continue;
+            x = ptr[0];
+            m = k == 6 ? (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2] : (ptr[4] << 16) | (ptr[3] << 8) | ptr[2];
+            frg = (uint8_t*)font + m;
+            if(frg >= end || (frg[0] & 0xE0) != 0xC0) continue;
+            for(g = (((frg[0] & 0x1F) << 8) | frg[1]) + 1, frg += 2; g-- && frg + 8 <= end; frg += 8) {
+                P = ((frg[2] & 0xF) << 16) | (frg[1] << 8) | frg[0];
+                e = ((frg[5] & 0xF) << 16) | (frg[4] << 8) | frg[3];
+                tmp = (uint8_t*)font + font->kerning_offs + ((((frg[2] >> 4) & 0xF) << 24) | (((frg[5] >> 4) & 0xF) << 16) |
+                    (frg[7] << 8) | frg[6]);
+                while(P <= e && tmp + 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F) <= end) {
+                    for(s = 0; s <= (uint32_t)(tmp[0] & 0x7F) && P <= e; s++, P++) {
+                        v = (signed char)tmp[1 + (tmp[0] & 0x80 ? 0 : s)];
+                        if(!v) continue;
+                        ret++;
+                        if(!idx->k) continue;
+                        for(m = SSFN_KERN_HASH(i, P) & (idx->nk - 1); idx->k[m].r && (idx->k[m].l != i || idx->k[m].r != P);
+                            m = (m + 1) & (idx->nk - 1));
+                        idx->k[m].l = i; idx->k[m].r = P;
+                        if(x) { if(!idx->k[m].x) idx->k[m].x = v; } else if(!idx->k[m].y) idx->k[m].y = v;
+                    }
+                    tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F);
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+/* length of a ligature string */
+static int _ssfn_ll(const ssfn_font_t *font, uint16_t offs)
+{
+    uint8_t *ptr;
+    for(ptr = (uint8_t*)font + offs; *ptr; ptr++);
+    return (int)(ptr - ((uint8_t*)font + offs));
+}
+
+/* build a code point and ligature index for a font */
+static ssfn_idx_t *_ssfn_ix(const ssfn_t *ctx, const ssfn_font_t *font)
+{
+    ssfn_idx_t *idx;
+    uint32_t i, j, m = 0;
+    uint16_t *l, k;
+    uint8_t *ptr, *end;
+
+    /* the characters table ends where the next table starts, don't trust it to cover the entire code range */
+    end = (uint8_t*)font + font->size - 4;
+    if(font->ligature_offs > font->characters_offs && (uint8_t*)font + font->ligature_offs < end)
+        end = (uint8_t*)font + font->ligature_offs;
+    if(font->kerning_offs > font->characters_offs && (uint8_t*)font + font->kerning_offs < end)
+        end = (uint8_t*)font + font->kerning_offs;
+    if(font->cmap_offs > font->characters_offs && (uint8_t*)font + font->cmap_offs < end)
+        end = (uint8_t*)font + font->cmap_offs;
+    for(ptr = (uint8_t*)font + font->characters_offs, i = 0; i < 0x110000 && ptr < end; i++) {
+        if(ptr[0] == 0xFF) { i += 65535; ptr++; }
+        else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
+        else if((ptr[0] & 0xC0) == 0x80) { j = (ptr[0] & 0x3F); i += j; ptr++; }
+        else { m = i; ptr += 6 + ptr[1] * (ptr[0] & 0x40 ? 6 : 5); }
+    }
+    idx = (ssfn_idx_t*)_ssfn_ma(ctx, NULL, sizeof(ssfn_idx_t));
+    if(!idx) return NULL;
+    idx->l = NULL; idx->nl = 0; idx->k = NULL; idx->nk = 0; idx->z = idx->m = NULL;
+    idx->nc = (m >> 8) + 1;
+    idx->c = (uint32_t**)_ssfn_ma(ctx, NULL, idx->nc * sizeof(uint32_t*));
+    if(!idx->c) { _ssfn_mf(ctx, idx); return NULL; }
+    SSFN_memset(idx->c, 0, idx->nc * sizeof(uint32_t*));
+    for(ptr = (uint8_t*)font + font->characters_offs, i = 0; i < 0x110000 && ptr < end; i++) {
+        if(ptr[0] == 0xFF) { i += 65535; ptr++; }
+        else if((ptr[0] & 0xC0) == 0xC0) { j = (((ptr[0] & 0x3F) << 8) | ptr[1]); i += j; ptr += 2; }
+        else if((ptr[0] & 0xC0) == 0x80) { j = (ptr[0] & 0x3F); i += j; ptr++; }
+        else {
+            if(!idx->c[i >> 8]) {
+                idx->c[i >> 8] = (uint32_t*)_ssfn_ma(ctx, NULL, 256 * sizeof(uint32_t));
+                if(!idx->c[i >> 8]) { _ssfn_fi(ctx, idx); return NULL; }
+                SSFN_memset(idx->c[i >> 8], 0, 256 * sizeof(uint32_t));
+            }
+            idx->c[i >> 8][i & 0xFF] = (uint32_t)(ptr - (uint8_t*)font);
+            ptr += 6 + ptr[1] * (ptr[0] & 0x40 ? 6 : 5);
+        }
+    }
+    if(font->ligature_offs) {
+        /* same for the ligatures table, which should be zero terminated, but might not be */
+        end = (uint8_t*)font + font->size - 4;
+        if(font->kerning_offs > font->ligature_offs && (uint8_t*)font + font->kerning_offs < end)
+            end = (uint8_t*)font + font->kerning_offs;
+        if(font->cmap_offs > font->ligature_offs && (uint8_t*)font + font->cmap_offs < end)
+            end = (uint8_t*)font + font->cmap_offs;
+        if(font->characters_offs > font->ligature_offs && (uint8_t*)font + font->characters_offs < end)
+            end = (uint8_t*)font + font->characters_offs;
+        l = (uint16_t*)((uint8_t*)font + font->ligature_offs);
+        for(idx->nl = 0; idx->nl < SSFN_LIG_LAST - SSFN_LIG_FIRST + 1 && (uint8_t*)&l[idx->nl + 1] <= end &&
+            l[idx->nl] && l[idx->nl] < font->size; idx->nl++);
+        if(idx->nl) {
+            idx->l = (uint16_t*)_ssfn_ma(ctx, NULL, (257 + idx->nl) * sizeof(uint16_t));
+            if(!idx->l) { _ssfn_fi(ctx, idx); return NULL; }
+            /* bucket ligatures by their first byte (empty strings go to bucket 0, which is never looked up) */
+            SSFN_memset(idx->l, 0, 257 * sizeof(uint16_t));
+            for(i = 0; i < (uint32_t)idx->nl; i++) idx->l[*((uint8_t*)font + l[i]) + 1]++;
+            for(i = 1; i < 257; i++) idx->l[i] += idx->l[i - 1];
+            for(i = 0; i < (uint32_t)idx->nl; i++) idx->l[257 + idx->l[*((uint8_t*)font + l[i])]++] = i;
+            for(i = 256; i > 0; i--) idx->l[i] = idx->l[i - 1];
+            idx->l[0] = 0;
+            /* order each bucket by length, longest first */
+            for(i = 1; i < 257; i++)
+                for(j = idx->l[i - 1] + 1; j < idx->l[i]; j++) {
+                    for(k = idx->l[257 + j], m = j; m > idx->l[i - 1] &&
+                        _ssfn_ll(font, l[idx->l[257 + m - 1]]) < _ssfn_ll(font, l[k]); m--)
+                            idx->l[257 + m] = idx->l[257 + m - 1];
+                    idx->l[257 + m] = k;
+                }
+        }
+    }
+    if(font->kerning_offs && (m = _ssfn_kp(font, idx))) {
+        /* kerning pairs, at most three quarters of the hash table used */
+        for(idx->nk = 16; (uint32_t)idx->nk * 3 < 4 * m; idx->nk <<= 1);
+        idx->k = (ssfn_kern_t*)_ssfn_ma(ctx, NULL, idx->nk * sizeof(ssfn_kern_t));
+        if(!idx->k) { _ssfn_fi(ctx, idx); return NULL; }
+        SSFN_memset(idx->k, 0, idx->nk * sizeof(ssfn_kern_t));
+        _ssfn_kp(font, idx);
+    }
+    return idx;
 }
 
 /*
  * gzip deflate uncompressor from stb_image.h with minor modifications to reduce dependency
  * stb_image - v2.23 - public domain image loader - http://nothings.org/stb_image.h
+ * modified to refill the bit buffer 32 bits at a time, with a bigger fast table and to copy matches 8 bytes at once
  */
-#define SSFN__ZFAST_BITS  9
+#define SSFN__ZFAST_BITS  11
 #define SSFN__ZFAST_MASK  ((1 << SSFN__ZFAST_BITS) - 1)
 
 typedef struct
@@ -535,11 +1498,12 @@ typedef struct
 {
    unsigned char *zbuffer;
    int num_bits;
-   uint32_t code_buffer;
+   uint64_t code_buffer;
 
    char *zout;
    char *zout_start;
    char *zout_end;
+   const ssfn_t *ctx;
 
    _ssfn__zhuffman z_length, z_distance;
 } _ssfn__zbuf;
@@ -549,50 +1513,52 @@ inline static unsigned char _ssfn__zget8(_ssfn__zbuf *z)
    return *z->zbuffer++;
 }
 
+/* add 32 bits at once when there are less than 32 left. This reads at most 7 bytes past the end of the deflate
+ * stream (3 bytes ahead, and 4 more), that's still within the gzip trailer */
+#define SSFN__ZREFILL(in, cb, nb) do { if (nb < 32) { \
+      cb |= ((uint64_t)(in)[0] | (uint64_t)(in)[1] << 8 | (uint64_t)(in)[2] << 16 | (uint64_t)(in)[3] << 24) << nb; \
+      in += 4; nb += 32; } } while (0)
+
 static void _ssfn__fill_bits(_ssfn__zbuf *z)
 {
-   do {
-      z->code_buffer |= (unsigned int) _ssfn__zget8(z) << z->num_bits;
-      z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   SSFN__ZREFILL(z->zbuffer, z->code_buffer, z->num_bits);
 }
 
 inline static unsigned int _ssfn__zreceive(_ssfn__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) _ssfn__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
 }
 
-static int _ssfn__zhuffman_decode_slowpath(_ssfn__zbuf *a, _ssfn__zhuffman *z)
+/* decode a symbol from a bit buffer which has at least 16 bits */
+inline static int _ssfn__zdecode(_ssfn__zhuffman *z, uint64_t *cb, int *nb)
 {
    int b,s,k;
-   k = _ssfn__bit_reverse(a->code_buffer, 16);
-   for (s=SSFN__ZFAST_BITS+1; ; ++s)
-      if (k < z->maxcode[s])
-         break;
-   if (s == 16) return -1;
-   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
-   a->code_buffer >>= s;
-   a->num_bits -= s;
-   return z->value[b];
+   b = z->fast[*cb & SSFN__ZFAST_MASK];
+   if (b) {
+      s = b >> 9;
+      b &= 511;
+   } else {
+      k = _ssfn__bit_reverse((int) (*cb & 0xFFFF), 16);
+      for (s=SSFN__ZFAST_BITS+1; ; ++s)
+         if (k < z->maxcode[s])
+            break;
+      if (s == 16) return -1;
+      b = z->value[(k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s]];
+   }
+   *cb >>= s;
+   *nb -= s;
+   return b;
 }
 
 inline static int _ssfn__zhuffman_decode(_ssfn__zbuf *a, _ssfn__zhuffman *z)
 {
-   int b,s;
    if (a->num_bits < 16) _ssfn__fill_bits(a);
-   b = z->fast[a->code_buffer & SSFN__ZFAST_MASK];
-   if (b) {
-      s = b >> 9;
-      a->code_buffer >>= s;
-      a->num_bits -= s;
-      return b & 511;
-   }
-   return _ssfn__zhuffman_decode_slowpath(a, z);
+   return _ssfn__zdecode(z, &a->code_buffer, &a->num_bits);
 }
 
 static int _ssfn__zexpand(_ssfn__zbuf *z, char *zout)
@@ -606,7 +1572,7 @@ static int _ssfn__zexpand(_ssfn__zbuf *z, char *zout)
        if(z->zout_start[0] != 'S' || z->zout_start[1] != 'F' || z->zout_start[2] != 'N') return 0;
        limit = *((uint32_t*)&z->zout_start[4]);
    } else return 0;
-   q = (char *) SSFN_realloc(z->zout_start, limit);
+   q = (char *) _ssfn_ma(z->ctx, z->zout_start, limit);
    if (q == NULL) return 0;
    z->zout_start = q;
    z->zout       = q + cur;
@@ -631,8 +1597,13 @@ static int _ssfn__zdist_extra[32] =
 static int _ssfn__parse_huffman_block(_ssfn__zbuf *a)
 {
    char *zout = a->zout;
+   unsigned char *in = a->zbuffer, *p;
+   uint64_t cb = a->code_buffer;
+   int nb = a->num_bits, z, e, len, dist;
    for(;;) {
-      int z = _ssfn__zhuffman_decode(a, &a->z_length);
+      /* refill before the 15 + 5 bits of a length and before the 15 + 13 bits of a distance */
+      SSFN__ZREFILL(in, cb, nb);
+      z = _ssfn__zdecode(&a->z_length, &cb, &nb);
       if (z < 256) {
          if (z < 0) return 0;
          if (zout >= a->zout_end) {
@@ -641,25 +1612,39 @@ static int _ssfn__parse_huffman_block(_ssfn__zbuf *a)
          }
          *zout++ = (char) z;
       } else {
-         unsigned char *p;
-         int len,dist;
-         if (z == 256) { a->zout = zout; return 1; }
+         if (z == 256) {
+            a->zout = zout;
+            a->zbuffer = in;
+            a->code_buffer = cb;
+            a->num_bits = nb;
+            return 1;
+         }
          z -= 257;
          len = _ssfn__zlength_base[z];
-         if (_ssfn__zlength_extra[z]) len += _ssfn__zreceive(a, _ssfn__zlength_extra[z]);
-         z = _ssfn__zhuffman_decode(a, &a->z_distance);
+         if ((e = _ssfn__zlength_extra[z])) { len += (int) (cb & ((1 << e) - 1)); cb >>= e; nb -= e; }
+         SSFN__ZREFILL(in, cb, nb);
+         z = _ssfn__zdecode(&a->z_distance, &cb, &nb);
          if (z < 0) return 0;
          dist = _ssfn__zdist_base[z];
-         if (_ssfn__zdist_extra[z]) dist += _ssfn__zreceive(a, _ssfn__zdist_extra[z]);
+         if ((e = _ssfn__zdist_extra[z])) { dist += (int) (cb & ((1 << e) - 1)); cb >>= e; nb -= e; }
          if (zout - a->zout_start < dist) return 0;
          if (zout + len > a->zout_end) {
+            /* copy what fits first, because expanding the first buffer needs the whole font header */
+            for (p = (unsigned char *) (zout - dist); len && zout < a->zout_end; len--)
+               *zout++ = *p++;
             if (!_ssfn__zexpand(a, zout)) return 0;
             zout = a->zout;
+            if (zout + len > a->zout_end) return 0;
          }
          p = (unsigned char *) (zout - dist);
-         if (dist == 1) {
-            unsigned char v = *p;
-            if (len) { do *zout++ = v; while (--len); }
+         if (dist >= 8 && a->zout_end - zout >= len + 8) {
+            /* the source is at least 8 bytes behind, so each copy reads what's already written. The
+             * last one might write past the match, but that's overwritten by the next symbols anyway */
+            do { SSFN_memcpy(zout, p, 8); zout += 8; p += 8; len -= 8; } while (len > 0);
+            zout += len;
+         } else if (dist == 1) {
+            SSFN_memset(zout, *p, len);
+            zout += len;
          } else {
             if (len) { do *zout++ = *p++; while (--len); }
          }
@@ -719,21 +1704,26 @@ inline static int _ssfn__parse_uncompressed_block(_ssfn__zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       _ssfn__zreceive(a, a->num_bits & 7);
-   k = 0;
-   while (a->num_bits > 0) {
-      header[k++] = (unsigned char) (a->code_buffer & 255);
-      a->code_buffer >>= 8;
-      a->num_bits -= 8;
-   }
-   while (k < 4)
-      header[k++] = _ssfn__zget8(a);
+   /* give back the whole bytes read ahead into the bit buffer */
+   a->zbuffer -= a->num_bits >> 3;
+   a->code_buffer = 0;
+   a->num_bits = 0;
+   for (k = 0; k < 4; k++)
+      header[k] = _ssfn__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return 0;
-   if (a->zout + len > a->zout_end)
+   if (a->zout + len > a->zout_end) {
+      /* same as with matches, fill up the buffer before expanding it */
+      k = (int) (a->zout_end - a->zout);
+      SSFN_memcpy(a->zout, a->zbuffer, k);
+      a->zout += k;
+      a->zbuffer += k;
+      len -= k;
       if (!_ssfn__zexpand(a, a->zout)) return 0;
-   for(k = 0; k < len; k++)
-       a->zout[k] = a->zbuffer[k];
+      if (a->zout + len > a->zout_end) return 0;
+   }
+   SSFN_memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
    return 1;
@@ -774,62 +1764,180 @@ static int _ssfn__parse_zlib(_ssfn__zbuf *a)
    return 1;
 }
 
-char *_ssfn_zlib_decode(const char *buffer)
+/* inflate a font with the context's allocator */
+static char *_ssfn_zd(const ssfn_t *ctx, const char *buffer)
 {
    _ssfn__zbuf a;
-   char *p = (char *) SSFN_realloc(NULL, 8);
+   char *p = (char *) _ssfn_ma(ctx, NULL, 8);
    if (p == NULL) return NULL;
    a.zbuffer = (unsigned char *) buffer;
-   a.zout_start = p; a.zout = p; a.zout_end = p + 8;
+   a.zout_start = p; a.zout = p; a.zout_end = p + 8; a.ctx = ctx;
    _ssfn__init_zdefaults();
-   if (_ssfn__parse_zlib(&a)) { return a.zout_start; } else { SSFN_free(a.zout_start); return NULL; }
+   if (_ssfn__parse_zlib(&a)) { return a.zout_start; } else { _ssfn_mf(ctx, a.zout_start); return NULL; }
 }
-#endif /* if !SSFN_MAXLINES */
 
-/*** Public API implementation ***/
+char *_ssfn_zlib_decode(const char *buffer)
+{
+   return _ssfn_zd(NULL, buffer);
+}
+
+/* inflate only the first n bytes (n isn't 8) into out, returns how many we got */
+static int _ssfn_zp(const uint8_t *buffer, char *out, int n)
+{
+   _ssfn__zbuf a;
+   a.zbuffer = (unsigned char *) buffer;
+   a.zout_start = out; a.zout = out; a.zout_end = out + n; a.ctx = NULL;
+   _ssfn__init_zdefaults();
+   _ssfn__parse_zlib(&a);
+   return (int) (a.zout - a.zout_start);
+}
+
+/* skip the gzip header, returns the deflate stream or NULL if it's not deflate compressed */
+static const uint8_t *_ssfn_gz(const uint8_t *ptr)
+{
+    int c, r;
+    if(ptr[2] != 8) return NULL;
+    c = ptr[3]; ptr += 10;
+    if(c & 4) { r = ptr[0] | (ptr[1] << 8); ptr += 2 + r; }
+    if(c & 8) { while(*ptr++ != 0); }
+    if(c & 16) { while(*ptr++ != 0); }
+    return ptr;
+}
+
+/* remember an allocated buffer of size bytes, so that it's freed along with the context */
+static int _ssfn_bf(ssfn_t *ctx, char *buf, int size)
+{
+    char **b = (char**)_ssfn_ma(ctx, ctx->bufs, (ctx->numbuf + 1) * sizeof(char*));
+    if(!b) { _ssfn_mf(ctx, buf); return 0; }
+    ctx->bufs = b; ctx->bufs[ctx->numbuf++] = buf; ctx->lenbuf += size;
+    return 1;
+}
+
+/* find the index of a font collection, that's the last chunk, and its size is in the last 4 bytes */
+static const ssfn_cidx_t *_ssfn_cx(const ssfn_font_t *font)
+{
+    const ssfn_cidx_t *ix;
+    uint32_t s;
+    if(font->size < 8 + sizeof(ssfn_cidx_t) + 4) return NULL;
+    s = *((uint32_t*)((uint8_t*)font + font->size - 4));
+    if(s < sizeof(ssfn_cidx_t) + 4 || s > font->size - 8) return NULL;
+    ix = (const ssfn_cidx_t*)((uint8_t*)font + font->size - s);
+    return !SSFN_memcmp(ix->magic, SSFN_COLLIDX, 4) && ix->size == s ? ix : NULL;
+}
 
 /**
- * Load a font or font collection into renderer context
- *
- * @param ctx rendering context
- * @param font SSFN font or font collection in memory
- * @return error code
+ * Get a mapped font ready on its first use: inflate it if it's compressed, check it and build its index. With str, only
+ * if the font might have a glyph for it, otherwise it's left alone and 0 returned just like when it failed to load
  */
-int ssfn_load(ssfn_t *ctx, const void *data)
+static int _ssfn_lz(ssfn_t *ctx, int n, int i, const char *str)
+{
+    ssfn_idx_t *idx = ctx->idx[n][i];
+    const ssfn_font_t *font = ctx->fnt[n][i];
+    const uint8_t *z;
+    uint32_t u;
+    int l;
+    if(!idx || !(z = idx->z)) return 1;
+    /* a font that failed to load covers nothing, so it's never tried again, and one that the collection index says has
+     * nothing for this code point isn't read in */
+    if(idx->m) {
+        if(idx->m == _ssfn_nocov) return 0;
+        if(str && (u = _ssfn_u((const uint8_t*)str, &l)) <= 0x10FFFF &&
+            !(idx->m[SSFN_COV_BIT(u) >> 3] & (1 << (SSFN_COV_BIT(u) & 7)))) return 0;
+    }
+    /* the header the font was registered with (inflated partially or copied into a collection index) must match */
+    if(z[0] == 0x1f && z[1] == 0x8b) {
+        if(!(z = _ssfn_gz(z)) || !(font = (const ssfn_font_t*)_ssfn_zd(ctx, (const char*)z))) goto err;
+        if(SSFN_memcmp(font, ctx->fnt[n][i], sizeof(ssfn_font_t)) ||
+            SSFN_memcmp((uint8_t*)font + font->size - 4, SSFN_ENDMAGIC, 4)) { _ssfn_mf(ctx, (void*)font); goto err; }
+        if(!_ssfn_bf(ctx, (char*)font, font->size)) goto err;
+    } else {
+        font = (const ssfn_font_t*)z;
+        if((font != ctx->fnt[n][i] && SSFN_memcmp(font, ctx->fnt[n][i], sizeof(ssfn_font_t))) ||
+            SSFN_memcmp((uint8_t*)font + font->size - 4, SSFN_ENDMAGIC, 4)) goto err;
+    }
+    ctx->fnt[n][i] = font;
+    /* the index is optional, without it lookups fall back to parsing the character table */
+    ctx->idx[n][i] = _ssfn_ix(ctx, font);
+    _ssfn_fi(ctx, idx);
+    _ssfn_lg(ctx, font, ctx->idx[n][i]);
+    return 1;
+err:
+    idx->m = _ssfn_nocov;
+    return 0;
+}
+#else
+#define _ssfn_lz(ctx,n,i,s) 1
+#endif /* if !SSFN_MAXLINES */
+
+/*** Public API implementation ***/
+
+/* load or map (lz) a font or collection, z is the font's data when data is only its header copied into an index, and
+ * m is its coverage from there */
+static int _ssfn_ld(ssfn_t *ctx, const void *data, int lz, const uint8_t *z, const uint8_t *m)
 {
     const ssfn_font_t *font = (const ssfn_font_t *)data;
     ssfn_font_t *fnt, *end;
     int family;
 #ifndef SSFN_MAXLINES
-    uint8_t c, r, *ptr = (uint8_t *)font;
+    const ssfn_cidx_t *ix;
+    const ssfn_cent_t *ce;
+    ssfn_idx_t *idx;
+    const uint8_t *d, *e;
+    char *ptr = NULL;
+    int i;
 #endif
     if(!ctx || !font)
         return SSFN_ERR_INVINP;
+#ifndef SSFN_MAXLINES
+    /* a shared registry is read-only */
+    if(ctx->fs) return SSFN_ERR_INVINP;
+#else
+    (void)z; (void)m;
+#endif
     if(((uint8_t *)font)[0] == 0x1f && ((uint8_t *)font)[1] == 0x8b) {
 #ifdef SSFN_MAXLINES
         return SSFN_ERR_BADFILE;
 #else
-        ptr += 2;
-        if(*ptr++ != 8) return SSFN_ERR_BADFILE;
-        c = *ptr++; ptr += 6;
-        if(c & 4) { r = *ptr++; r += (*ptr++ << 8); ptr += r; }
-        if(c & 8) { while(*ptr++ != 0); }
-        if(c & 16) { while(*ptr++ != 0); }
-        font = (ssfn_font_t*)_ssfn_zlib_decode((const char*)ptr);
-        if(!font) return SSFN_ERR_BADFILE;
-        ctx->bufs = (char**)SSFN_realloc(ctx->bufs, (ctx->numbuf + 1) * sizeof(char*));
-        if(!ctx->bufs) { ctx->numbuf = 0; return SSFN_ERR_ALLOC; }
-        ctx->bufs[ctx->numbuf++] = (char*)font;
-        ctx->lenbuf += font->size;
+        if(!(d = _ssfn_gz((const uint8_t*)font))) return SSFN_ERR_BADFILE;
+        if(lz) {
+            /* inflate the header and the name only, unless it's a collection, that's compressed as a whole */
+            if(!(ptr = (char*)_ssfn_ma(ctx, NULL, SSFN_PEEK_MAX))) return SSFN_ERR_ALLOC;
+            i = _ssfn_zp(d, ptr, SSFN_PEEK_MAX); font = (ssfn_font_t*)ptr;
+            if(i < (int)sizeof(ssfn_font_t) || !SSFN_memcmp(font->magic, SSFN_COLLECTION, 4)) {
+                _ssfn_mf(ctx, ptr); ptr = NULL;
+            } else if(font->size > (uint32_t)i) z = (const uint8_t*)data;
+        }
+        if(!ptr) {
+            if(!(ptr = _ssfn_zd(ctx, (const char*)d))) return SSFN_ERR_BADFILE;
+            z = NULL;
+        }
+        font = (ssfn_font_t*)ptr;
+        if(!_ssfn_bf(ctx, ptr, z ? SSFN_PEEK_MAX : (int)font->size)) return SSFN_ERR_ALLOC;
 #endif
     }
     if(!SSFN_memcmp(font->magic, SSFN_COLLECTION, 4)) {
         end = (ssfn_font_t*)((uint8_t*)font + font->size);
-        for(fnt = (ssfn_font_t*)((uint8_t*)font + 8); fnt < end && !ssfn_load(ctx, (const void *)fnt);
+#ifndef SSFN_MAXLINES
+        if((ix = _ssfn_cx(font))) {
+            /* with an index, fonts are found without walking through them, and they might be compressed one by one.
+             * When mapped, fonts are registered with their headers in the index, so they aren't touched until used */
+            e = (const uint8_t*)ix + ix->size - 4;
+            for(i = 0, ce = (const ssfn_cent_t*)(ix + 1); i < (int)ix->num; i++) {
+                for(d = (const uint8_t*)ce + sizeof(ssfn_cent_t); d < e && *d; d++);
+                if(d >= e || ce->offs < 8 || ce->offs > (uint32_t)((const uint8_t*)ix - (const uint8_t*)font) ||
+                    ce->size < sizeof(ssfn_font_t) || ce->size > (uint32_t)((const uint8_t*)ix - (const uint8_t*)font) - ce->offs ||
+                    _ssfn_ld(ctx, lz ? (const void*)&ce->hdr : (const void*)((const uint8_t*)font + ce->offs), lz,
+                        (const uint8_t*)font + ce->offs, ce->cov)) break;
+                ce = (const ssfn_cent_t*)((const uint8_t*)ce + ((d - (const uint8_t*)ce + 4) & ~3));
+            }
+        } else
+#endif
+        for(fnt = (ssfn_font_t*)((uint8_t*)font + 8); fnt < end && !_ssfn_ld(ctx, (const void *)fnt, lz, NULL, NULL);
             fnt = (ssfn_font_t*)((uint8_t*)fnt + fnt->size));
     } else {
         family = SSFN_TYPE_FAMILY(font->type);
-        if(SSFN_memcmp(font->magic, SSFN_MAGIC, 4) || SSFN_memcmp((uint8_t*)font + font->size - 4, SSFN_ENDMAGIC, 4) ||
+        /* a mapped font's end is only checked on first use, so that its pages aren't touched until then */
+        if(SSFN_memcmp(font->magic, SSFN_MAGIC, 4) || (!lz && SSFN_memcmp((uint8_t*)font + font->size - 4, SSFN_ENDMAGIC, 4)) ||
             family > SSFN_FAMILY_HAND || font->fragments_offs >= font->size || font->characters_offs >= font->size ||
             font->ligature_offs >= font->size || font->kerning_offs >= font->size || font->cmap_offs >= font->size ||
             font->fragments_offs >= font->characters_offs) {
@@ -839,18 +1947,95 @@ int ssfn_load(ssfn_t *ctx, const void *data)
 #ifdef SSFN_MAXLINES
             if(ctx->len[family] > 15) return SSFN_ERR_ALLOC;
 #else
-            ctx->fnt[family] = (const ssfn_font_t**)SSFN_realloc(ctx->fnt[family], ctx->len[family]*sizeof(void*));
-            if(!ctx->fnt[family]) {
+            ctx->fnt[family] = (const ssfn_font_t**)_ssfn_ma(ctx, ctx->fnt[family], ctx->len[family]*sizeof(void*));
+            ctx->idx[family] = (ssfn_idx_t**)_ssfn_ma(ctx, ctx->idx[family], ctx->len[family]*sizeof(void*));
+            if(!ctx->fnt[family] || !ctx->idx[family]) {
                 ctx->len[family] = 0;
                 return SSFN_ERR_ALLOC;
+            }
+            if(lz) {
+                /* an empty index for now, which also remembers where the font's data is */
+                if(!(idx = (ssfn_idx_t*)_ssfn_ma(ctx, NULL, sizeof(ssfn_idx_t)))) { ctx->len[family]--; return SSFN_ERR_ALLOC; }
+                SSFN_memset(idx, 0, sizeof(ssfn_idx_t));
+                idx->z = z ? z : (const uint8_t*)font; idx->m = m;
+                ctx->idx[family][ctx->len[family]-1] = idx;
             } else
+                /* the index is optional, without it lookups fall back to parsing the character table */
+                ctx->idx[family][ctx->len[family]-1] = idx = _ssfn_ix(ctx, font);
+            /* a mapped font's ligatures are only known once it's loaded, but until then it isn't used either */
+            if(!idx || !idx->z) _ssfn_lg(ctx, font, idx);
+            /* the new font might change which font is picked for a glyph */
+            if(ctx->r) SSFN_memset(ctx->r, 0, SSFN_RES_MAX * sizeof(ssfn_res_t));
 #endif
-                ctx->fnt[family][ctx->len[family]-1] = font;
+            ctx->fnt[family][ctx->len[family]-1] = font;
         }
+    }
+    return SSFN_OK;
+}
+
+/**
+ * Load a font or font collection into renderer context
+ *
+ * @param ctx rendering context
+ * @param font SSFN font or font collection in memory
+ * @return error code
+ */
+int ssfn_load(ssfn_t *ctx, const void *data)
+{
+    return _ssfn_ld(ctx, data, 0, NULL, NULL);
+}
+
+/**
+ * Map a font or font collection into renderer context without reading it. Only the font headers are looked at, each font
+ * is checked, indexed and inflated when one of its glyphs is first looked up. Data must stay in memory (mapped) until the
+ * context is freed. With SSFN_MAXLINES, this is the same as ssfn_load()
+ *
+ * @param ctx rendering context
+ * @param font SSFN font or font collection in memory, probably a memory mapped file
+ * @return error code
+ */
+int ssfn_map(ssfn_t *ctx, const void *data)
+{
+#ifdef SSFN_MAXLINES
+    return _ssfn_ld(ctx, data, 0, NULL, NULL);
+#else
+    return _ssfn_ld(ctx, data, 1, NULL, NULL);
+#endif
+}
+
+/**
+ * Set up a lightweight renderer context which uses the fonts loaded into another context. Nothing is copied, the
+ * registry is shared, so that context must not load more fonts nor be freed while this one is in use. Each context has
+ * its own glyph cache and work buffers, so contexts sharing the same fonts can be used from different threads. Mapped
+ * fonts are read in now, because a shared registry is never modified
+ *
+ * @param ctx rendering context to set up
+ * @param fonts rendering context with the fonts loaded
+ * @return error code
+ */
+int ssfn_share(ssfn_t *ctx, const ssfn_t *fonts)
+{
+    int i, j;
+    if(!ctx || !fonts || ctx == fonts) return SSFN_ERR_INVINP;
 #ifndef SSFN_MAXLINES
-        _ssfn_fc(ctx);
+    for(i = 0; !fonts->fs && i < 5; i++)
+        for(j = 0; j < fonts->len[i]; j++)
+            if(!_ssfn_lz((ssfn_t*)fonts, i, j, NULL)) return SSFN_ERR_BADFILE;
 #endif
+    ssfn_free(ctx);
+    for(i = 0; i < 5; i++) {
+#ifdef SSFN_MAXLINES
+        for(j = 0; j < 16; j++) ctx->fnt[i][j] = fonts->fnt[i][j];
+#else
+        ctx->fnt[i] = fonts->fnt[i];
+        ctx->idx[i] = fonts->idx[i];
+#endif
+        ctx->len[i] = fonts->len[i];
     }
+#ifndef SSFN_MAXLINES
+    for(i = 0; i < (int)sizeof(ctx->lb); i++) ctx->lb[i] = fonts->lb[i];
+    ctx->fs = fonts->fs ? fonts->fs : fonts;
+#endif
     return SSFN_OK;
 }
 
@@ -862,21 +2047,39 @@ int ssfn_load(ssfn_t *ctx, const void *data)
 void ssfn_free(ssfn_t *ctx)
 {
 #ifndef SSFN_MAXLINES
-    int i;
+    void *(*ma)(void*, void*, int);
+    void (*mf)(void*, void*);
+    void *md;
+    int i, j;
 #endif
     if(!ctx) return;
 #ifndef SSFN_MAXLINES
     _ssfn_fc(ctx);
     if(ctx->bufs) {
         for(i = 0; i < ctx->numbuf; i++)
-            if(ctx->bufs[i]) SSFN_free(ctx->bufs[i]);
-        SSFN_free(ctx->bufs);
+            if(ctx->bufs[i]) _ssfn_mf(ctx, ctx->bufs[i]);
+        _ssfn_mf(ctx, ctx->bufs);
     }
-    for(i = 0; i < 5; i++)
-        if(ctx->fnt[i]) SSFN_free(ctx->fnt[i]);
-    if(ctx->p) SSFN_free(ctx->p);
-#endif
+    /* the registry of a shared context belongs to the context it was shared from */
+    for(i = 0; !ctx->fs && i < 5; i++) {
+        if(ctx->fnt[i]) _ssfn_mf(ctx, ctx->fnt[i]);
+        if(ctx->idx[i]) {
+            for(j = 0; j < ctx->len[i]; j++)
+                _ssfn_fi(ctx, ctx->idx[i][j]);
+            _ssfn_mf(ctx, ctx->idx[i]);
+        }
+    }
+    if(ctx->r) _ssfn_mf(ctx, ctx->r);
+    if(ctx->p) _ssfn_mf(ctx, ctx->p);
+    if(ctx->e) _ssfn_mf(ctx, ctx->e);
+    if(ctx->ca) _ssfn_mf(ctx, ctx->ca);
+    /* the allocator stays, so the context can be used again */
+    ma = ctx->ma; mf = ctx->mf; md = ctx->md;
+    SSFN_memset(ctx, 0, sizeof(ssfn_t));
+    ctx->ma = ma; ctx->mf = mf; ctx->md = md;
+#else
     SSFN_memset(ctx, 0, sizeof(ssfn_t));
+#endif
 }
 
 /**
@@ -893,24 +2096,125 @@ int ssfn_mem(ssfn_t *ctx)
     int i, j, k, ret = sizeof(ssfn_t);
 
     if(!ctx) return 0;
-    for(i = 0; i < 5; i++) ret += ctx->len[i] * sizeof(ssfn_font_t*);
-    ret += ctx->lenbuf;
+    /* shared fonts are counted only once, in the context owning them */
+    for(i = 0; !ctx->fs && i < 5; i++) {
+        ret += ctx->len[i] * (sizeof(ssfn_font_t*) + sizeof(ssfn_idx_t*));
+        for(j = 0; j < ctx->len[i]; j++)
+            if(ctx->idx[i][j]) {
+                ret += sizeof(ssfn_idx_t) + ctx->idx[i][j]->nc * sizeof(uint32_t*);
+                for(k = 0; k < ctx->idx[i][j]->nc; k++)
+                    if(ctx->idx[i][j]->c[k]) ret += 256 * sizeof(uint32_t);
+                if(ctx->idx[i][j]->l) ret += (257 + ctx->idx[i][j]->nl) * sizeof(uint16_t);
+                ret += ctx->idx[i][j]->nk * sizeof(ssfn_kern_t);
+            }
+    }
+#ifdef SSFN_CACHEARENA
+    /* cached glyphs and their page tables are all in the arena blocks */
+    ret += ctx->lenbuf + ctx->an;
+#else
+    ret += ctx->lenbuf + ctx->cs;
     for(k = 0; k <= 16; k++) {
         if(ctx->c[k]) {
             for(j = 0; j < 256; j++)
                 if(ctx->c[k][j]) {
-                    for(i = 0; i < 256; i++)
-                        if(ctx->c[k][j][i]) ret += 8 + ctx->c[k][j][i]->p * ctx->c[k][j][i]->h;
                     ret += 256 * sizeof(void*);
                 }
             ret += 256 * sizeof(void*);
         }
     }
-    if(ctx->p) ret += ctx->ap * sizeof(uint16_t);
+#endif
+    if(ctx->r) ret += SSFN_RES_MAX * sizeof(ssfn_res_t);
+    if(ctx->p) ret += ctx->ap * sizeof(uint16_t) + (ctx->ap >> 1) * sizeof(uint16_t);
+    ret += ctx->nca * sizeof(int);
     return ret;
 #endif
 }
 
+/**
+ * Flush the internal glyph cache
+ *
+ * @param ctx rendering context
+ */
+void ssfn_flush(ssfn_t *ctx)
+{
+#ifndef SSFN_MAXLINES
+    _ssfn_fc(ctx);
+#elif defined(SSFN_STATICCACHE)
+    if(!ctx) return;
+    SSFN_memset(ctx->ss, 0, sizeof(ctx->ss));
+    ctx->sw = 0;
+#else
+    (void)ctx;
+#endif
+}
+
+/**
+ * Set the glyph cache budget, least recently used glyphs are evicted to stay below
+ *
+ * @param ctx rendering context
+ * @param size maximum number of bytes used by cached glyphs, 0 for unlimited
+ */
+void ssfn_cachesize(ssfn_t *ctx, int size)
+{
+#ifndef SSFN_MAXLINES
+    if(!ctx) return;
+    ctx->cm = size < 0 ? 0 : size;
+#ifndef SSFN_SHAREDCACHE
+    if(ctx->cm) _ssfn_ev(ctx, 0);
+#endif
+#else
+    (void)ctx; (void)size;
+#endif
+}
+
+/**
+ * Use another allocator instead of SSFN_realloc and SSFN_free for everything the context allocates, including the
+ * buffers returned by ssfn_text() and ssfn_atlas(). Must be set on an empty context, it stays until changed
+ *
+ * @param ctx rendering context
+ * @param alloc allocate (ptr NULL) or resize ptr to size bytes like realloc, NULL for the default
+ * @param release free ptr, NULL for the default
+ * @param data passed to the callbacks as is
+ * @return error code
+ */
+int ssfn_allocator(ssfn_t *ctx, void *(*alloc)(void *data, void *ptr, int size),
+    void (*release)(void *data, void *ptr), void *data)
+{
+#ifndef SSFN_MAXLINES
+    int i;
+    if(!ctx || !alloc != !release || ctx->bufs || ctx->r || ctx->p || ctx->ca) return SSFN_ERR_INVINP;
+    /* memory already allocated would be freed with the wrong allocator */
+    for(i = 0; i < 5; i++) if(ctx->fnt[i]) return SSFN_ERR_INVINP;
+    for(i = 0; i <= 16; i++) if(ctx->c[i]) return SSFN_ERR_INVINP;
+    ctx->ma = alloc; ctx->mf = release; ctx->md = data;
+#else
+    (void)ctx; (void)alloc; (void)release; (void)data;
+#endif
+    return SSFN_OK;
+}
+
+/**
+ * Query the profiling counters, they are only collected when compiled with SSFN_PROFILING
+ *
+ * @param ctx rendering context
+ * @param stats returned counters, can be NULL
+ * @param reset non-zero to start counting from zero again (per frame for example)
+ * @return error code
+ */
+int ssfn_stats(ssfn_t *ctx, ssfn_stats_t *stats, int reset)
+{
+    if(!ctx) return SSFN_ERR_INVINP;
+#ifdef SSFN_PROFILING
+    if(stats) *stats = ctx->st;
+    if(reset) SSFN_memset(&ctx->st, 0, sizeof(ssfn_stats_t));
+    return SSFN_OK;
+#else
+    if(stats) SSFN_memset(stats, 0, sizeof(ssfn_stats_t));
+    (void)reset;
+    return SSFN_ERR_INVINP;
+#endif
+}
+
 /**
  * Set up rendering parameters
  *
@@ -926,10 +2230,7 @@ int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size)
     int i, j, l;
 
     if(!ctx) return SSFN_ERR_INVINP;
-#ifndef SSFN_MAXLINES
-    _ssfn_fc(ctx);
-#endif
-    if((style & ~0x1FFF)) return SSFN_ERR_BADSTYLE;
+    if((style & ~0x3FFFF)) return SSFN_ERR_BADSTYLE;
     if(size < 8 || size > SSFN_SIZE_MAX) return SSFN_ERR_BADSIZE;
 
     if(family == SSFN_FAMILY_BYNAME) {
@@ -938,7 +2239,11 @@ int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size)
         for(i=0; i < 5; i++) {
             for(j=0; j < ctx->len[i]; j++) {
                 if(!SSFN_memcmp(name, (uint8_t*)&ctx->fnt[i][j]->magic + sizeof(ssfn_font_t), l)) {
+                    if(!_ssfn_lz(ctx, i, j, NULL)) return SSFN_ERR_BADFILE;
                     ctx->s = ctx->fnt[i][j];
+#ifndef SSFN_MAXLINES
+                    ctx->si = ctx->idx[i][j];
+#endif
                     goto familyfound;
                 }
             }
@@ -946,10 +2251,10 @@ int ssfn_select(ssfn_t *ctx, int family, const char *name, int style, int size)
         return SSFN_ERR_NOFACE;
     } else {
         if(family != SSFN_FAMILY_ANY && (family > SSFN_FAMILY_HAND || !ctx->len[family])) return SSFN_ERR_NOFACE;
-        ctx->s = NULL;
+        ctx->s = NULL; ctx->si = NULL;
     }
 familyfound:
-    ctx->f = NULL;
+    ctx->f = NULL; ctx->fi = NULL;
     ctx->family = family;
     ctx->style = style;
     ctx->size = size;
@@ -969,59 +2274,95 @@ familyfound:
 int ssfn_render(ssfn_t *ctx, ssfn_buf_t *dst, const char *str)
 {
     ssfn_font_t **fl;
-    uint8_t *ptr = NULL, *frg, *end, *tmp, color, ci = 0, cb = 0, cs, dec[65536];
+    ssfn_idx_t **xl;
+#ifndef SSFN_MAXLINES
+    ssfn_res_t *rs = NULL;
+    ssfn_glyph_t *g;
+    int mh = 0;
+#endif
+#if !defined(SSFN_MAXLINES) || defined(SSFN_STATICCACHE)
+    uint32_t ck;
+#endif
+    uint8_t *ptr = NULL, *frg, *end, *tmp, *cp = NULL, color, ci = 0, cb = 0, cv = 0, lc = 0, ms, cs, fm, dec[65536], *Op, *Ol;
     uint16_t r[640];
-    uint32_t unicode, P, O, *Op, *Ol;
+    uint32_t unicode, P, O;
     unsigned long int sR, sG, sB, sA;
-    int ret = 0, i, j, k, l, p, m, n, o, s, x, y, w, h, a, A, b, B, nr, uix, uax;
-    int ox, oy, y0, y1, Y0, Y1, x0, x1, X0, X1, X2, xs, ys, yp, pc, fB, fG, fR, fA, bB, bG, bR, dB, dG, dR, dA;
+    int ret = 0, i, j, k, l, p, m, n, o, s, x, y, w, h, a, A, b, B, nr, ne, na, ni, uix, uax, bp;
+    int ox, oy, y0, y1, Y0, Y1, x0, x1, X0, X1, X2, xs, ys, yp, pc, fB, fG, fR, fA, bB, bG, bR, dB, dG, dR, dA, ph, ps, px, pw;
 #ifdef SSFN_PROFILING
-    struct timeval tv0, tv1, tvd;
-    gettimeofday(&tv0, NULL);
+    uint64_t tc = SSFN_CLOCK();
 #endif
 
-    if(!ctx || !str) return SSFN_ERR_INVINP;
+    if(!ctx || !str || (dst && (ctx->style & SSFN_STYLE_BUFFMT) && dst->f > SSFN_FMT_A8)) return SSFN_ERR_INVINP;
     if(!*str) return 0;
-    if(*str == '\r') { dst->x = 0; return 1; }
-    if(*str == '\n') { dst->x = 0; dst->y += ctx->line ? ctx->line : ctx->size; return 1; }
+    if(*str == '\r') { dst->x = 0; dst->fx = 0; return 1; }
+    if(*str == '\n') { dst->x = 0; dst->fx = 0; dst->y += ctx->line ? ctx->line : ctx->size; return 1; }
+    /* the pen's fraction rounded to the nearest phase, ps is one if that's the next whole pixel */
+    ph = dst && (ctx->style & SSFN_STYLE_SUBPIXEL) ? ((dst->fx & 63) * SSFN_SUBPIXEL + 32) >> 6 : 0;
+    ps = ph / SSFN_SUBPIXEL; ph %= SSFN_SUBPIXEL;
 
     if(ctx->s) {
-        ctx->f = ctx->s;
-        ptr = _ssfn_c(ctx->f, str, &ret, &unicode);
-    } else {
+        ctx->f = ctx->s; ctx->fi = ctx->si;
+        ptr = _ssfn_c(ctx->f, ctx->fi, str, &ret, &unicode);
+    } else
+#ifndef SSFN_MAXLINES
+    if((rs = _ssfn_r(ctx, str, &unicode, &l)) && rs->l == l && rs->u == unicode && rs->fm == (uint8_t)ctx->family &&
+        rs->st == (ctx->style & 3) && rs->sz == ctx->size) {
+        /* we have already looked for this code point with the same requirements */
+        SSFN_PROF(ctx->st.memo++);
+        ctx->f = rs->f; ctx->fi = rs->fi; ptr = rs->c; ret = rs->l;
+    } else
+#endif
+    {
         /* find best match */
         p = ctx->family;
-        ctx->f = NULL;
+        ctx->f = NULL; ctx->fi = NULL;
 again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
         for(; n <= m; n++) {
             fl = (ssfn_font_t **)ctx->fnt[n];
+#ifndef SSFN_MAXLINES
+            xl = ctx->idx[n];
+#else
+            xl = _ssfn_noidx;
+#endif
             if(ctx->style & 3) {
                 /* check if we have a specific ctx->f for the requested style and size */
                 for(i=0;i<ctx->len[n];i++)
-                    if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && fl[i]->height == ctx->size &&
-                        (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                    if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && fl[i]->height == ctx->size && _ssfn_lz(ctx, n, i, str) &&
+                        (SSFN_PROF(ctx->st.probes++), ptr = _ssfn_c(fl[i], xl[i], str, &ret, &unicode))) { ctx->f = fl[i]; ctx->fi = xl[i]; break; }
                 /* if not, check if we have the requested size (for bitmap fonts) */
                 if(!ptr)
                     for(i=0;i<ctx->len[n];i++)
-                        if(fl[i]->height == ctx->size && (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                        if(fl[i]->height == ctx->size && _ssfn_lz(ctx, n, i, str) && (SSFN_PROF(ctx->st.probes++), ptr = _ssfn_c(fl[i], xl[i], str, &ret, &unicode)))
+                            { ctx->f = fl[i]; ctx->fi = xl[i]; break; }
                 /* if neither size+style nor size matched, look for style match */
                 if(!ptr)
                     for(i=0;i<ctx->len[n];i++)
-                        if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && (ptr = _ssfn_c(fl[i], str, &ret, &unicode)))
-                            { ctx->f = fl[i]; break; }
+                        if(((fl[i]->type>>4) & 3) == (ctx->style & 3) && _ssfn_lz(ctx, n, i, str) &&
+                            (SSFN_PROF(ctx->st.probes++), ptr = _ssfn_c(fl[i], xl[i], str, &ret, &unicode)))
+                            { ctx->f = fl[i]; ctx->fi = xl[i]; break; }
                 /* if bold italic was requested, check if we have at least bold or italic */
                 if(!ptr && (ctx->style & 3) == 3)
                     for(i=0;i<ctx->len[n];i++)
-                        if(((fl[i]->type>>4) & 3) && (ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                        if(((fl[i]->type>>4) & 3) && _ssfn_lz(ctx, n, i, str) && (SSFN_PROF(ctx->st.probes++), ptr = _ssfn_c(fl[i], xl[i], str, &ret, &unicode)))
+                            { ctx->f = fl[i]; ctx->fi = xl[i]; break; }
             }
             /* last resort, get the first ctx->f which has a glyph for this multibyte, no matter style */
             if(!ptr) {
                 for(i=0;i<ctx->len[n];i++)
-                    if((ptr = _ssfn_c(fl[i], str, &ret, &unicode))) { ctx->f = fl[i]; break; }
+                    if(_ssfn_lz(ctx, n, i, str) && (SSFN_PROF(ctx->st.probes++), ptr = _ssfn_c(fl[i], xl[i], str, &ret, &unicode))) {
+                        ctx->f = fl[i]; ctx->fi = xl[i]; break;
+                    }
             }
         }
         /* if glyph still not found, try any family group */
         if(!ptr && p != SSFN_FAMILY_ANY) { p = SSFN_FAMILY_ANY; goto again; }
+#ifndef SSFN_MAXLINES
+        if(rs && ret > 0) {
+            rs->f = ctx->f; rs->fi = ctx->fi; rs->c = ptr; rs->u = unicode; rs->l = ret;
+            rs->fm = ctx->family; rs->st = ctx->style & 3; rs->sz = ctx->size;
+        }
+#endif
     }
     if(!ptr) {
         if(ctx->style & SSFN_STYLE_NODEFGLYPH) return SSFN_ERR_NOGLYPH;
@@ -1029,8 +2370,14 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
             unicode = 0;
             if(ctx->family >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = ctx->family;
             for(; n <= m && !ptr; n++)
-                if(ctx->len[n] && ctx->fnt[n][0] && !(*((uint8_t*)ctx->fnt[n][0] + ctx->fnt[n][0]->characters_offs) & 0x80))
-                    { ctx->f = ctx->fnt[n][0]; ptr = (uint8_t*)ctx->f + ctx->f->characters_offs; }
+                if(ctx->len[n] && ctx->fnt[n][0] && _ssfn_lz(ctx, n, 0, NULL) &&
+                    !(*((uint8_t*)ctx->fnt[n][0] + ctx->fnt[n][0]->characters_offs) & 0x80))
+                    {
+                        ctx->f = ctx->fnt[n][0]; ptr = (uint8_t*)ctx->f + ctx->f->characters_offs;
+#ifndef SSFN_MAXLINES
+                        ctx->fi = ctx->idx[n][0];
+#endif
+                    }
         }
         if(!ptr) return SSFN_ERR_NOGLYPH;
     }
@@ -1038,53 +2385,89 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
     if((unicode >> 16) > 0x10) return SSFN_ERR_INVINP;
     ctx->rc = (ssfn_chr_t*)ptr; ptr += sizeof(ssfn_chr_t);
 
-#ifdef SSFN_PROFILING
-    gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec; tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
-    if(tvd.tv_usec < 0) { tvd.tv_sec--; tvd.tv_usec += 1000000L; }
-    ctx->lookup += tvd.tv_sec * 1000000L + tvd.tv_usec;
-    memcpy(&tv0, &tv1, sizeof(struct timeval));
-#endif
+    SSFN_PROF(_ssfn_pt(ctx, SSFN_STAT_LOOKUP, &tc));
     /* render glyph into cache */
 #ifndef SSFN_MAXLINES
-    if(!(ctx->style & SSFN_STYLE_NOCACHE) && ctx->c[unicode >> 16] && ctx->c[unicode >> 16][(unicode >> 8) & 0xFF] &&
-        ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF]) {
-            ctx->g = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF];
-    } else
+    /* exact coverage is calculated at the size it will be displayed, but only for contours in foreground color */
+    if((ctx->style & (SSFN_STYLE_COVERAGE | SSFN_STYLE_NOAA)) == SSFN_STYLE_COVERAGE) {
+        h = (ctx->style & SSFN_STYLE_ABS_SIZE) || SSFN_TYPE_FAMILY(ctx->f->type) == SSFN_FAMILY_MONOSPACE ||
+            !ctx->f->baseline ? ctx->size : ctx->size * ctx->f->height / ctx->f->baseline;
+        cv = h < 256;
+        for(n = 0, tmp = ptr; cv && n < ctx->rc->n; n++) {
+            if(tmp[0] == 255 && tmp[1] == 255) {
+                if(ctx->f->cmap_offs && tmp[2] != 0xFE) cv = 0;
+                tmp += ctx->rc->t & 0x40 ? 6 : 5; continue;
+            }
+            if(ctx->rc->t & 0x40) { m = (tmp[5] << 24) | (tmp[4] << 16) | (tmp[3] << 8) | tmp[2]; tmp += 6; }
+            else { m = (tmp[4] << 16) | (tmp[3] << 8) | tmp[2]; tmp += 5; }
+            if((*((uint8_t*)ctx->f + m) & 0xC0) == 0x80) cv = 0;
+        }
+    }
+    if(!cv)
 #endif
-    {
-        h = ctx->style & SSFN_STYLE_NOAA ? ctx->size : (ctx->size > ctx->f->height ? (ctx->size + 4) & ~3 : ctx->f->height);
-        ci = (ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC);
-        cb = (ctx->style & SSFN_STYLE_BOLD) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_BOLD) ? (ctx->f->height+64)>>6 : 0;
+    h = ctx->style & SSFN_STYLE_NOAA ? ctx->size : (ctx->size > ctx->f->height ? (ctx->size + 4) & ~3 : ctx->f->height);
+    ci = (ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC);
+    cb = (ctx->style & SSFN_STYLE_BOLD) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_BOLD) ? (ctx->f->height+64)>>6 : 0;
+    ctx->g = NULL;
+#ifndef SSFN_MAXLINES
+    ck = (ci ? SSFN_STYLE_ITALIC : 0) | (cb ? SSFN_STYLE_BOLD : 0) | (ctx->style & SSFN_STYLE_NOAA) |
+        (cv ? SSFN_STYLE_COVERAGE : 0);
+    if(!(ctx->style & SSFN_STYLE_NOCACHE)) {
+        /* look for the glyph already scaled to the displayed size first (not for bounding boxes, those use the sketch) */
+        if((ctx->style & (SSFN_STYLE_MASKCACHE | SSFN_STYLE_SUBPIXEL | SSFN_STYLE_LCD)) && !cv && dst && dst->ptr) {
+            mh = (ctx->style & SSFN_STYLE_ABS_SIZE) || SSFN_TYPE_FAMILY(ctx->f->type) == SSFN_FAMILY_MONOSPACE ||
+                !ctx->f->baseline ? ctx->size : ctx->size * ctx->f->height / ctx->f->baseline;
+            /* LCD masks have one alpha per stripe, so only for glyphs in the foreground color */
+            lc = (ctx->style & (SSFN_STYLE_LCD | SSFN_STYLE_NOAA)) == SSFN_STYLE_LCD && !ctx->f->cmap_offs;
+            if(mh > 255) mh = 0;
+            else if((ctx->g = _ssfn_gc(ctx, unicode, ck | SSFN_STYLE_MASKCACHE | (ctx->size << 16) | (ph << 24) | (lc << 28),
+                mh))) {
+                /* an empty mask means the glyph can't be stored as one */
+                if(!ctx->g->p) { ctx->g = NULL; mh = 0; }
+                else { cv = 1; cp = ctx->f->cmap_offs ? ctx->g->data + ctx->g->p * mh : NULL; }
+            }
+        }
+        if(!ctx->g) ctx->g = _ssfn_gc(ctx, unicode, ck, h);
+    }
+#elif defined(SSFN_STATICCACHE)
+    ck = (ci ? SSFN_STYLE_ITALIC : 0) | (cb ? SSFN_STYLE_BOLD : 0) | (ctx->style & SSFN_STYLE_NOAA);
+    if(!(ctx->style & SSFN_STYLE_NOCACHE)) ctx->g = _ssfn_sc(ctx, unicode, ck, h);
+#endif
+    SSFN_PROF(ctx->g ? ctx->st.hits++ : ctx->st.misses++);
+    if(!ctx->g) {
         w = (ctx->rc->w * h + ctx->f->height - 1) / ctx->f->height;
         p = w + (ci ? h / SSFN_ITALIC_DIV : 0) + cb;
         /* failsafe, should never happen */
         if(p * h >= SSFN_DATA_MAX) return SSFN_ERR_BADSIZE;
+        /* when only measuring (no pixel buffer), the metrics are enough, no need to rasterize nor to cache */
+        ms = dst && !dst->ptr;
 #ifndef SSFN_MAXLINES
-        if(!(ctx->style & SSFN_STYLE_NOCACHE)) {
-            if(!ctx->c[unicode >> 16]) {
-                ctx->c[unicode >> 16] = (ssfn_glyph_t***)SSFN_realloc(NULL, 256 * sizeof(void*));
-                if(!ctx->c[unicode >> 16]) return SSFN_ERR_ALLOC;
-                SSFN_memset(ctx->c[unicode >> 16], 0, 256 * sizeof(void*));
+        if(cv && !ms) {
+            if(ctx->nca < (p + 2) * h) {
+                ctx->nca = (p + 2) * h;
+                ctx->ca = (int*)_ssfn_ma(ctx, ctx->ca, ctx->nca * sizeof(int));
+                if(!ctx->ca) { ctx->nca = 0; return SSFN_ERR_ALLOC; }
             }
-            if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) {
-                ctx->c[unicode >> 16][(unicode >> 8) & 0xFF] = (ssfn_glyph_t**)SSFN_realloc(NULL, 256 * sizeof(void*));
-                if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF]) return SSFN_ERR_ALLOC;
-                SSFN_memset(ctx->c[unicode >> 16][(unicode >> 8) & 0xFF], 0, 256 * sizeof(void*));
-            }
-            ctx->g = ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF] = (ssfn_glyph_t*)SSFN_realloc(NULL, p * h + 8);
-            if(!ctx->c[unicode >> 16][(unicode >> 8) & 0xFF][unicode & 0xFF]) return SSFN_ERR_ALLOC;
+            SSFN_memset(ctx->ca, 0, (p + 2) * h * sizeof(int));
+        }
+        /* glyphs that would not fit in the budget at all are rendered without caching */
+        if(!ms && !(ctx->style & SSFN_STYLE_NOCACHE) && SSFN_CACHE_FITS(ctx, SSFN_CACHE_SIZE(p, h), 0)) {
+            if(!(ctx->g = _ssfn_ga(ctx, unicode, ck, p, h))) return SSFN_ERR_ALLOC;
         } else
+#elif defined(SSFN_STATICCACHE)
+        if(ms || (ctx->style & SSFN_STYLE_NOCACHE) || !(ctx->g = _ssfn_sa(ctx, unicode, ck, p, h)))
 #endif
             ctx->g = &ctx->ga;
+        SSFN_PROF(ctx->st.sketch += ctx->g != &ctx->ga ? 8 + p * h : 0);
         x = (ctx->rc->x > 0 && ci ? (ctx->f->height - ctx->f->baseline) * h / SSFN_ITALIC_DIV / ctx->f->height : 0);
         ctx->g->p = p;
         ctx->g->h = h;
         ctx->g->x = ctx->rc->x + x;
         ctx->g->y = ctx->rc->y;
         ctx->g->o = (ctx->rc->t & 0x3F) + x;
-        SSFN_memset(&ctx->g->data, 0xFF, p * h);
+        if(!ms) SSFN_memset(&ctx->g->data, 0xFF, p * h);
         color = 0xFE; ctx->g->a = ctx->g->d = 0;
-        for(n = 0; n < ctx->rc->n; n++) {
+        for(n = 0; !ms && n < ctx->rc->n; n++) {
             if(ptr[0] == 255 && ptr[1] == 255) { color = ptr[2]; ptr += ctx->rc->t & 0x40 ? 6 : 5; continue; }
             x = ((ptr[0] + cb) << SSFN_PREC) * h / ctx->f->height; y = (ptr[1] << SSFN_PREC) * h / ctx->f->height;
             if(ctx->rc->t & 0x40) { m = (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 6; }
@@ -1117,29 +2500,19 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                 /* close path */
                 if(ctx->mx != ctx->lx || ctx->my != ctx->ly) { ctx->p[ctx->np+0] = ctx->mx; ctx->p[ctx->np+1] = ctx->my; ctx->np += 2; }
                 /* add rasterized vector layers to cached glyph */
+#ifndef SSFN_MAXLINES
+                if(cv) _ssfn_ac(ctx, p, h, ci); else
+#endif
                 if(ctx->np > 4) {
-                    for(b = A = B = o = 0; b < h; b++, B += p) {
-                        a = b << SSFN_PREC;
-                        for(nr = 0, i = 0; i < ctx->np - 3; i += 2) {
-                            if( (ctx->p[i+1] < a && ctx->p[i+3] >= a) ||
-                                (ctx->p[i+3] < a && ctx->p[i+1] >= a)) {
-                                    if((ctx->p[i+1] >> SSFN_PREC) == (ctx->p[i+3] >> SSFN_PREC))
-                                        x = (((int)ctx->p[i]+(int)ctx->p[i+2])>>1);
-                                    else
-                                        x = ((int)ctx->p[i]) + ((a - (int)ctx->p[i+1])*
-                                            ((int)ctx->p[i+2] - (int)ctx->p[i])/
-                                            ((int)ctx->p[i+3] - (int)ctx->p[i+1]));
-                                    x >>= SSFN_PREC;
-                                    if(ci) x += (h - b) / SSFN_ITALIC_DIV;
-                                    if(cb && !o) {
-                                        if(ctx->g->data[B + x] != color) { o = -cb; A = cb; }
-                                        else { o = cb; A = -cb; }
-                                    }
-                                    for(k = 0; k < nr && x > r[k]; k++);
-                                    for(l = nr; l > k; l--) r[l] = r[l-1];
-                                    r[k] = x;
-                                    nr++;
-                            }
+                    ne = _ssfn_es(ctx->p, ctx->np, ctx->e); na = ni = 0;
+                    for(b = A = B = o = 0; b < h && (na || ni < ne); b++, B += p) {
+                        nr = _ssfn_ae(ctx->p, ctx->e, ne, &na, &ni, b, r, 640);
+                        if(ci) for(i = 0; i < nr; i++) r[i] += (h - b) / SSFN_ITALIC_DIV;
+                        /* the direction of the first edge in the outline tells where to embolden */
+                        if(cb && !o && nr) {
+                            for(k = 0, i = 1; i < nr; i++) if(ctx->e[i] < ctx->e[k]) k = i;
+                            if(ctx->g->data[B + r[k]] != color) { o = -cb; A = cb; }
+                            else { o = cb; A = -cb; }
                         }
                         if(nr > 1 && nr & 1) { r[nr - 2] = r[nr - 1]; nr--; }
                         if(nr) {
@@ -1211,26 +2584,70 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
             }
             color = 0xFE;
         }
+#ifndef SSFN_MAXLINES
+        if(cv && !ms) _ssfn_cr(ctx, p, h, (cb << 8) * h / ctx->f->height);
+#endif
         ctx->g->a = ctx->f->baseline;
         if(ctx->g->d > ctx->g->a + 1) ctx->g->d -= ctx->g->a + 1; else ctx->g->d = 0;
+#if defined(SSFN_SHAREDCACHE) && !defined(SSFN_MAXLINES)
+        if(ctx->g != &ctx->ga) _ssfn_gp(ctx, ctx->g);
+#endif
 #ifdef SSFN_DEBUGGLYPH
         printf("\nU+%06X size %d p %d h %d base %d under %d overlap %d ascender %d descender %d advance x %d advance y %d cb %d\n",
             unicode, ctx->size,p,h,ctx->f->baseline,ctx->f->underline,ctx->g->o,ctx->g->a,ctx->g->d,ctx->g->x,ctx->g->y,cb);
         for(j = 0; j < h; j++) { printf("%3d: ", j); for(i = 0; i < p; i++) { if(ctx->g->data[j*p+i] == 0xFF) printf(j == ctx->g->a ? "_" : "."); else printf("%x", ctx->g->data[j*p+i] & 0xF); } printf("\n"); }
 #endif
-#ifdef SSFN_PROFILING
-        gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec; tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
-        if(tvd.tv_usec < 0) { tvd.tv_sec--; tvd.tv_usec += 1000000L; }
-        ctx->raster += tvd.tv_sec * 1000000L + tvd.tv_usec;
-        memcpy(&tv0, &tv1, sizeof(struct timeval));
+        SSFN_PROF(_ssfn_pt(ctx, SSFN_STAT_RASTER, &tc));
+    }
+#ifndef SSFN_MAXLINES
+    if(mh && !cv) {
+        /* scale the sketch down once and cache it, unless that would evict the sketch itself */
+        w = ctx->g->p * mh / ctx->g->h; n = ctx->size > 16 ? 2 : 1;
+        if(w < n) w = n;
+        /* phase variants are shifted right, so they have an extra column, LCD masks have 3 samples per pixel and a margin
+         * of one pixel on both sides for the filter */
+        p = lc ? 3 * (w + 2 + (ph != 0)) : w + (ph != 0); k = mh * (ctx->f->cmap_offs ? 2 : 1);
+        if(SSFN_CACHE_FITS(ctx, SSFN_CACHE_SIZE(p, k), ctx->g != &ctx->ga ? SSFN_CACHE_SIZE(ctx->g->p, ctx->g->h) : 0)) {
+            ck |= SSFN_STYLE_MASKCACHE | (ctx->size << 16) | (ph << 24) | (lc << 28);
+            if(!(g = _ssfn_ga(ctx, unicode, ck, p, k))) return SSFN_ERR_ALLOC;
+            g->p = p; g->h = mh; g->o = ctx->g->o; g->x = ctx->g->x; g->y = ctx->g->y; g->a = ctx->g->a; g->d = ctx->g->d;
+            cp = ctx->f->cmap_offs ? g->data + p * mh : NULL;
+            if(lc) {
+                /* sample the sketch at 3x horizontal resolution, then filter the stripes */
+                k = (ph * 768) / SSFN_SUBPIXEL;
+                _ssfn_dm(ctx->g, 3 * w, mh, k, g->data, NULL);
+                _ssfn_lf(g->data, 3 * w + ((k + 255) >> 8), mh, p, dec);
+                ctx->g = g; cv = 1;
+            } else
+            if(_ssfn_dm(ctx->g, w, mh, (ph << 8) / SSFN_SUBPIXEL, g->data, cp)) { ctx->g = g; cv = 1; }
+            else {
+                /* palette colors are blended in some pixels, remember that and keep using the sketch */
+                _ssfn_gr(ctx, (ssfn_cache_t*)g - 1); cp = NULL;
+                if(!(g = _ssfn_ga(ctx, unicode, ck, 0, 0))) return SSFN_ERR_ALLOC;
+                g->p = 0; g->h = mh;
+            }
+#ifdef SSFN_SHAREDCACHE
+            _ssfn_gp(ctx, g);
 #endif
+            SSFN_PROF(ctx->st.mask += 8 + p * k);
+            SSFN_PROF(_ssfn_pt(ctx, SSFN_STAT_RASTER, &tc));
+        }
     }
+#endif
     if(dst) {
         /* blit glyph from cache into buffer */
         h = (ctx->style & SSFN_STYLE_ABS_SIZE) || SSFN_TYPE_FAMILY(ctx->f->type) == SSFN_FAMILY_MONOSPACE || !ctx->f->baseline ?
             ctx->size : ctx->size * ctx->f->height / ctx->f->baseline;
         if(h > ctx->line) ctx->line = h;
+        /* without a mask for the phase, the glyph is drawn at the nearest whole pixel */
+#ifndef SSFN_MAXLINES
+        if(!mh || !cv)
+#endif
+        { ps += ph * 2 >= SSFN_SUBPIXEL; ph = 0; lc = 0; }
+        /* the masks' extra columns are only drawn, they don't count in the glyph's width */
         w = ctx->g->p * h / ctx->g->h;
+        if(lc) w = w / 3 - 2;
+        w -= ph != 0;
         s = ((ctx->g->x - ctx->g->o) * h + ctx->f->height - 1) / ctx->f->height;
         n = ctx->size > 16 ? 2 : 1;
         if(w < n) w = n;
@@ -1239,9 +2656,10 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
             ctx->ox = ox = ((ctx->g->o * h + ctx->f->height - 1) / ctx->f->height) + (ctx->style & SSFN_STYLE_RTL ? w : 0);
             ctx->oy = oy = (ctx->g->a * h + ctx->f->height - 1) / ctx->f->height;
         } else { ctx->ox = ox = w / 2; ctx->oy = oy = 0; }
+        ox += lc - ps; pw = w + (ph != 0) + (lc ? 2 : 0);
         if(dst->ptr) {
             j = dst->w < 0 ? -dst->w : dst->w;
-            cs = dst->w < 0 ? 16 : 0;
+            cs = dst->w < 0 ? 16 : 0; fm = ctx->style & SSFN_STYLE_BUFFMT ? dst->f : SSFN_FMT_ARGB; bp = SSFN_FMT_BPP(fm);
             cb = (h + 64) >> 6; uix = w > s ? w : s; uax = 0;
             n = (ctx->f->underline * h + ctx->f->height - 1) / ctx->f->height;
 #ifdef SSFN_DEBUGGLYPH
@@ -1250,22 +2668,63 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
 #endif
             fR = (dst->fg >> 16) & 0xFF; fG = (dst->fg >> 8) & 0xFF; fB = (dst->fg >> 0) & 0xFF; fA = (dst->fg >> 24) & 0xFF;
             bR = (dst->bg >> 16) & 0xFF; bG = (dst->bg >> 8) & 0xFF; bB = (dst->bg >> 0) & 0xFF;
-            Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy) + ((dst->x - ox) << 2));
-            for (y = 0; y < h && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
+            if(fm == SSFN_FMT_PARGB) {
+                /* blending with a premultiplied background gives premultiplied results */
+                k = (dst->bg >> 24) & 0xFF; bR = bR * k / 255; bG = bG * k / 255; bB = bB * k / 255;
+            }
+            Op = dst->ptr + dst->p * (dst->y - oy) + (dst->x - ox) * bp;
+            for (y = 0; y < h && dst->y + y - oy < dst->h; y++, Op += dst->p) {
                 if(dst->y + y - oy < 0) continue;
                 y0 = (y << 8) * ctx->g->h / h; Y0 = y0 >> 8; y1 = ((y + 1) << 8) * ctx->g->h / h; Y1 = y1 >> 8; Ol = Op;
-                for (x = 0; x < w && dst->x + x - ox < j; x++, Ol++) {
+                for (x = 0; x < pw && dst->x + x - ox < j; x++, Ol += bp) {
                     if(dst->x + x - ox < 0) continue;
                     m = 0; sR = sG = sB = sA = 0;
                     if(!dst->bg) {
-                        /* real linear frame buffers should be accessed only as uint32_t on 32 bit boundary */
-                        O = *Ol;
-                        bR = (O >> (16 - cs)) & 0xFF;
+                        O = _ssfn_pg(Ol, fm, cs);
+                        bR = (O >> 16) & 0xFF;
                         bG = (O >> 8) & 0xFF;
-                        bB = (O >> cs) & 0xFF;
+                        bB = O & 0xFF;
+                    }
+                    if(lc) {
+                        /* LCD mask, an alpha for each stripe, blended per channel */
+                        k = y * ctx->g->p + x * 3;
+                        dR = ctx->g->data[k + (cs ? 2 : 0)] * fA / 255; dG = ctx->g->data[k + 1] * fA / 255;
+                        dB = ctx->g->data[k + (cs ? 0 : 2)] * fA / 255;
+                        dA = dR > dG ? (dR > dB ? dR : dB) : (dG > dB ? dG : dB);
+                        if(dA > 15) {
+                            sR = (fR * dR + bR * (255 - dR)) / 255; sG = (fG * dG + bG * (255 - dG)) / 255;
+                            sB = (fB * dB + bB * (255 - dB)) / 255;
+                            _ssfn_pp(Ol, fm, cs, ((uint32_t)dA << 24) | (sR << 16) | (sG << 8) | sB);
+                            if(y == n) { if(uix > x) { uix = x; } if(uax < x) { uax = x; } }
+                        }
+                        continue;
+                    }
+                    if(cv) {
+                        /* coverage was calculated at this size, no scaling needed (but w is at least n, even for spaces) */
+                        if(x >= ctx->g->p) continue;
+                        k = cp ? cp[y * ctx->g->p + x] : 0xFE;
+                        if(k == 0xFE) { dR = fR; dG = fG; dB = fB; dA = fA; }
+                        else {
+                            P = *((uint32_t*)((uint8_t*)ctx->f + ctx->f->cmap_offs + (k << 2)));
+                            dR = (P >> 16) & 0xFF; dG = (P >> 8) & 0xFF; dB = (P >> 0) & 0xFF; dA = (P >> 24) & 0xFF;
+                        }
+                        dA = ctx->g->data[y * ctx->g->p + x] * dA / 255;
+                        if(dA > 15) {
+                            sR = (dR * dA + bR * (255 - dA)) / 255; sG = (dG * dA + bG * (255 - dA)) / 255;
+                            sB = (dB * dA + bB * (255 - dA)) / 255;
+                            _ssfn_pp(Ol, fm, cs, ((uint32_t)dA << 24) | (sR << 16) | (sG << 8) | sB);
+                            if(y == n) { if(uix > x) { uix = x; } if(uax < x) { uax = x; } }
+                        }
+                        continue;
                     }
                     x0 = (x << 8) * ctx->g->p / w; X0 = x0 >> 8; x1 = ((x + 1) << 8) * ctx->g->p / w; X1 = x1 >> 8;
-                    for(ys = y0; ys < y1; ys += 256) {
+                    a = b = 0;
+                    if(fA == 255 && _ssfn_bx(ctx->g, ctx->f->cmap_offs, x0, x1, y0, y1, &m, &a, &b)) {
+                        /* opaque foreground, only need to know how much of the area is background */
+                        sB = bB * a + fB * (m - a); sG = bG * a + fG * (m - a); sR = bR * a + fR * (m - a);
+                        sA = 255 * b + 255 * (m - a);
+                    } else
+                    for(m = 0, ys = y0; ys < y1; ys += 256) {
                         if(ys >> 8 == Y0) { yp = 256 - (ys & 0xFF); ys &= ~0xFF; if(yp > y1 - y0) yp = y1 - y0; }
                         else if(ys >> 8 == Y1) yp = y1 & 0xFF; else yp = 256;
                         X2 = (ys >> 8) * ctx->g->p;
@@ -1297,8 +2756,8 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                     }
                     if(m) { sR /= m; sG /= m; sB /= m; sA /= m; } else { sR >>= 8; sG >>= 8; sB >>= 8; sA >>= 8; }
                     if(sA > 15) {
-                        *Ol = ((sA > 255 ? 255 : sA) << 24) | ((sR > 255 ? 255 : sR) << (16 - cs)) |
-                            ((sG > 255 ? 255 : sG) << 8) | ((sB > 255 ? 255 : sB) << cs);
+                        _ssfn_pp(Ol, fm, cs, ((sA > 255 ? 255 : sA) << 24) | ((sR > 255 ? 255 : sR) << 16) |
+                            ((sG > 255 ? 255 : sG) << 8) | (sB > 255 ? 255 : sB));
                         if(y == n) { if(uix > x) { uix = x; } if(uax < x) { uax = x; } }
                     }
                 }
@@ -1307,48 +2766,59 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                 uix -= cb + 1; uax += cb + 2;
                 if(uax < uix) uax = uix + 1;
                 k = (w > s ? w : s);
-                Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy + n) + ((dst->x - ox - 1) << 2));
-                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
+                Op = dst->ptr + dst->p * (dst->y - oy + n) + (dst->x - ox - 1) * bp;
+                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p) {
                     if(dst->y + y - oy < 0) continue;
-                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox < j; x++, Ol++) {
-                        if(dst->x + x - ox < 0 || (x > uix && x < uax)) continue;
-                        O = *Ol;
-                        bR = (O >> (16 - cs)) & 0xFF; bG = (O >> 8) & 0xFF; bB = (O >> cs) & 0xFF;
+                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox - 1 < j; x++, Ol += bp) {
+                        if(dst->x + x - ox - 1 < 0 || (x > uix && x < uax)) continue;
+                        O = _ssfn_pg(Ol, fm, cs);
+                        bR = (O >> 16) & 0xFF; bG = (O >> 8) & 0xFF; bB = O & 0xFF;
                         bB += ((fB - bB) * fA) >> 8;  bG += ((fG - bG) * fA) >> 8; bR += ((fR - bR) * fA) >> 8;
-                        *Ol = (fA << 24) | (bR << (16 - cs)) | (bG << 8) | (bB << cs);
+                        _ssfn_pp(Ol, fm, cs, ((uint32_t)fA << 24) | (bR << 16) | (bG << 8) | bB);
                     }
                 }
             }
             if(ctx->style & SSFN_STYLE_STHROUGH) {
                 n = (h >> 1); k = (w > s ? w : s) + 1;
-                Op = (uint32_t*)(dst->ptr + dst->p * (dst->y - oy + n) + ((dst->x - ox - 1) << 2));
-                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p >> 2) {
+                Op = dst->ptr + dst->p * (dst->y - oy + n) + (dst->x - ox - 1) * bp;
+                for (y = n; y < n + cb && dst->y + y - oy < dst->h; y++, Op += dst->p) {
                     if(dst->y + y - oy < 0) continue;
-                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox < j; x++, Ol++) {
-                        if(dst->x + x - ox < 0) continue;
-                        O = *Ol;
-                        bR = (O >> (16 - cs)) & 0xFF; bG = (O >> 8) & 0xFF; bB = (O >> cs) & 0xFF;
+                    for (Ol = Op, x = 0; x <= k && dst->x + x - ox - 1 < j; x++, Ol += bp) {
+                        if(dst->x + x - ox - 1 < 0) continue;
+                        O = _ssfn_pg(Ol, fm, cs);
+                        bR = (O >> 16) & 0xFF; bG = (O >> 8) & 0xFF; bB = O & 0xFF;
                         bB += ((fB - bB) * fA) >> 8; bG += ((fG - bG) * fA) >> 8; bR += ((fR - bR) * fA) >> 8;
-                        *Ol = (fA << 24) | (bR << (16 - cs)) | (bG << 8) | (bB << cs);
+                        _ssfn_pp(Ol, fm, cs, ((uint32_t)fA << 24) | (bR << 16) | (bG << 8) | bB);
                     }
                 }
             }
-#ifdef SSFN_PROFILING
-            gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec;tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
-            if(tvd.tv_usec < 0) { tvd.tv_sec--; tvd.tv_usec += 1000000L; }
-            ctx->blit += tvd.tv_sec * 1000000L + tvd.tv_usec;
-            memcpy(&tv0, &tv1, sizeof(struct timeval));
-#endif
+            SSFN_PROF(_ssfn_pt(ctx, SSFN_STAT_BLIT, &tc));
         }
-        /* add advance and kerning */
+        /* add advance and kerning, with subpixel positioning in 1/64 pixels so that rounding errors don't add up */
         ctx->ax = (ctx->style & SSFN_STYLE_RTL ? -s : s);
-        dst->x += ctx->ax;
+        if(ctx->style & SSFN_STYLE_SUBPIXEL) {
+            k = ((ctx->g->x - ctx->g->o) * h * 64 + ctx->f->height / 2) / ctx->f->height;
+            n = ctx->size > 16 ? 128 : 64;
+            if(k < n) k = n;
+            px = dst->x * 64 + dst->fx + (ctx->style & SSFN_STYLE_RTL ? -k : k); o = 64;
+        } else { px = dst->x + ctx->ax; o = 1; }
         dst->y += (ctx->g->y * h + ctx->f->height - 1) / ctx->f->height;
         ptr = (uint8_t*)str + ret;
-        if(!(ctx->style & SSFN_STYLE_NOKERN) && ctx->f->kerning_offs && _ssfn_c(ctx->f, (const char*)ptr, &i, &P) && P > 32) {
+        if(!(ctx->style & SSFN_STYLE_NOKERN) && ctx->f->kerning_offs &&
+            _ssfn_c(ctx->f, ctx->fi, (const char*)ptr, &i, &P) && P > 32) {
+#ifndef SSFN_MAXLINES
+            /* pairs were collected on load, a single look up is enough */
+            if(ctx->fi && ctx->fi->k)
+                for(k = SSFN_KERN_HASH(unicode, P) & (ctx->fi->nk - 1); ctx->fi->k[k].r; k = (k + 1) & (ctx->fi->nk - 1))
+                    if(ctx->fi->k[k].l == unicode && ctx->fi->k[k].r == P) {
+                        px += (int)ctx->fi->k[k].x * h * o / ctx->f->height;
+                        dst->y += (int)ctx->fi->k[k].y * h / ctx->f->height;
+                        break;
+                    }
+#endif
             ptr = (uint8_t*)ctx->rc + sizeof(ssfn_chr_t);
-            /* check all kerning fragments, because we might have both vertical and horizontal kerning offsets */
-            for(n = 0; n < ctx->rc->n; n++) {
+            /* without an index, check all kerning fragments, because we might have both vertical and horizontal offsets */
+            for(n = 0; !ctx->fi && n < ctx->rc->n; n++) {
                 if(ptr[0] == 255 && ptr[1] == 255) { ptr += ctx->rc->t & 0x40 ? 6 : 5; continue; }
                 x = ptr[0];
                 if(ctx->rc->t & 0x40) { m = (ptr[5] << 24) | (ptr[4] << 16) | (ptr[3] << 8) | ptr[2]; ptr += 6; }
@@ -1368,8 +2838,8 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                                     P -= (tmp[0] & 0x7F) + 1;
                                     tmp += 2 + (tmp[0] & 0x80 ? 0 : tmp[0] & 0x7F);
                                 } else {
-                                    y = (int)((signed char)tmp[1 + ((tmp[0] & 0x80) ? 0 : P)]) * h / ctx->f->height;
-                                    if(x) dst->x += y; else dst->y += y;
+                                    y = (int)((signed char)tmp[1 + ((tmp[0] & 0x80) ? 0 : P)]) * h;
+                                    if(x) px += y * o / ctx->f->height; else dst->y += y / ctx->f->height;
                                     break;
                                 }
                             }
@@ -1379,12 +2849,9 @@ again:  if(p >= SSFN_FAMILY_BYNAME) { n = 0; m = 4; } else n = m = p;
                     }
                 }
             }
-#ifdef SSFN_PROFILING
-            gettimeofday(&tv1, NULL); tvd.tv_sec = tv1.tv_sec - tv0.tv_sec; tvd.tv_usec = tv1.tv_usec - tv0.tv_usec;
-            if(tvd.tv_usec < 0) { tvd.tv_sec--; tvd.tv_usec += 1000000L; }
-            ctx->kern += tvd.tv_sec * 1000000L + tvd.tv_usec;
-#endif
+            SSFN_PROF(_ssfn_pt(ctx, SSFN_STAT_KERN, &tc));
         }
+        if(o == 64) { dst->fx = px & 63; dst->x = (px - dst->fx) / 64; } else dst->x = px;
     }
     return ret;
 }
@@ -1422,7 +2889,7 @@ int ssfn_bbox(ssfn_t *ctx, const char *str, int *w, int *h, int *left, int *top)
     }
     if((ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC))
         buf.x +=  ctx->size / SSFN_ITALIC_DIV - l;
-    if(ctx->g->x) { *w = buf.x; *h = ctx->line; *left = l; *top = t; }
+    if(ctx->g->x) { *w = buf.x + (buf.fx != 0); *h = ctx->line; *left = l; *top = t; }
     else { *w = buf.w; *h = buf.y; *top = *left = 0; }
     return SSFN_OK;
 }
@@ -1437,30 +2904,246 @@ int ssfn_bbox(ssfn_t *ctx, const char *str, int *w, int *h, int *left, int *top)
 ssfn_buf_t *ssfn_text(ssfn_t *ctx, const char *str, unsigned int fg)
 {
 #ifndef SSFN_MAXLINES
-    ssfn_buf_t *buf;
-    int ret;
+    ssfn_buf_t *buf, s;
+    const char *c;
+    int ret = SSFN_ERR_ALLOC, i, k, l, t, w, h, x, y, a, m;
 
     if(!ctx || !str) return NULL;
-    buf = (ssfn_buf_t*)SSFN_realloc(NULL, sizeof(ssfn_buf_t));
+    buf = (ssfn_buf_t*)_ssfn_ma(ctx, NULL, sizeof(ssfn_buf_t));
     if(!buf) return NULL;
     SSFN_memset(buf, 0, sizeof(ssfn_buf_t));
     buf->fg = fg;
-    if(!*str || ssfn_bbox(ctx, str, (int*)&buf->w, (int*)&buf->h, (int*)&buf->x, (int*)&buf->y) != SSFN_OK)
-        return buf;
-    buf->ptr = (uint8_t*)SSFN_realloc(NULL, buf->w * buf->h * sizeof(uint32_t));
-    SSFN_memset(buf->ptr, 0, buf->w * buf->h * sizeof(uint32_t));
-    while((ret = ssfn_render(ctx, buf, str)) > 0)
-        str += ret;
-    if(ret != SSFN_OK) { SSFN_free(buf->ptr); SSFN_free(buf); return NULL; }
+    if(!*str) return buf;
+    /* the first glyph's metrics give the left margin, ascender and line height, which are the same for the whole string
+     * unless there's a fallback font. So instead of measuring the string first, we render it in a single pass into a
+     * buffer which only grows in width as the pen moves, and start over only if a glyph did not fit after all */
+    SSFN_memset(&s, 0, sizeof(ssfn_buf_t));
+    s.fg = fg; ctx->line = 0;
+    if(ssfn_render(ctx, &s, str) < 1 || !ctx->g) return buf;
+    if(!ctx->g->x) {
+        /* vertical text, measure it first */
+        if(ssfn_bbox(ctx, str, &w, &h, &x, &y) != SSFN_OK) return buf;
+        if(!_ssfn_tg(ctx, &s, w, h)) goto err;
+        s.x = x; s.y = y;
+        while((ret = ssfn_render(ctx, &s, str)) > 0) str += ret;
+        if(ret != SSFN_OK) goto err;
+        goto done;
+    }
+    l = ctx->ox; t = ctx->oy; h = ctx->line; m = ctx->size + 4;
+    for(c = str; *c; c++);
+    w = l + (c - str) * ctx->size * 3 / 4 + m;
+again:
+    if(s.ptr) { _ssfn_mf(ctx, s.ptr); s.ptr = NULL; s.w = s.h = 0; }
+    if(!_ssfn_tg(ctx, &s, w, h)) goto err;
+    s.x = l; s.fx = 0; s.y = t; ctx->line = 0; a = 0;
+    for(c = str; *c; c += ret) {
+        if(s.x + m > s.w && !_ssfn_tg(ctx, &s, s.x + m, h)) goto err;
+        x = s.x;
+        if((ret = ssfn_render(ctx, &s, c)) < 1 || !ctx->g) goto err;
+        if(ctx->oy > a) a = ctx->oy;
+        /* check if the glyph was cut off on the right (its scaled width is at most p * line / h, plus the under- and
+         * strike-through lines might be one pixel wider) */
+        k = (ctx->g->p * ctx->line + ctx->g->h - 1) / ctx->g->h;
+        i = ctx->ax < 0 ? -ctx->ax : ctx->ax;
+        k = x - ctx->ox + (k > i ? k : i) + 2;
+        if(k > s.w) { w = 2 * k; goto again; }
+    }
+    if(a != t || ctx->line != h) { t = a; h = ctx->line; w = s.w; goto again; }
+    w = s.x + (s.fx != 0);
+    if((ctx->style & SSFN_STYLE_ITALIC) && !(SSFN_TYPE_STYLE(ctx->f->type) & SSFN_STYLE_ITALIC))
+        w += ctx->size / SSFN_ITALIC_DIV - l;
+    if(w < 1 || !_ssfn_tg(ctx, &s, w, h)) goto err;
+    s.w = w;
+done:
+    buf->ptr = s.ptr; buf->p = s.p; buf->w = s.w; buf->h = s.h; buf->x = s.x; buf->y = s.y;
     return buf;
+err:
+    if(s.ptr) _ssfn_mf(ctx, s.ptr);
+    /* a string with missing glyphs gives an empty buffer, just like when it couldn't be measured */
+    if(ret != SSFN_ERR_ALLOC && ret < 0) return buf;
+    _ssfn_mf(ctx, buf);
+    return NULL;
+#else
+    (void)ctx;
+    (void)str;
+    (void)fg;
+    return NULL;
+#endif
+}
+
+/**
+ * Render each character of a string into a newly allocated glyph atlas
+ *
+ * @param ctx rendering context
+ * @param str characters to put in the atlas
+ * @param fg foreground color
+ * @param fmt pixel format of the atlas, SSFN_FMT_x
+ * @param w width of the atlas, 0 for automatic
+ * @return a newly allocated atlas or NULL
+ */
+ssfn_atlas_t *ssfn_atlas(ssfn_t *ctx, const char *str, unsigned int fg, int fmt, int w)
+{
+#ifndef SSFN_MAXLINES
+    ssfn_atlas_t *atlas = NULL;
+    ssfn_rect_t *r = NULL;
+    ssfn_buf_t s;
+    const char *c;
+    char u[8];
+    uint8_t *d = NULL;
+    uint32_t *q;
+    int *o = NULL, ret, st, i, j, k, l, n, x, y, x0, y0, x1, y1, bw, bh, nd = 0, sh, mw = 0, mh = 0, h;
+    long a = 0;
+
+    if(!ctx || !str || fmt < SSFN_FMT_ARGB || fmt > SSFN_FMT_A8 || w < 0) return NULL;
+    for(c = str, n = 0; *c; c += l) { _ssfn_u((const uint8_t*)c, &l); n++; }
+    if(!(r = (ssfn_rect_t*)_ssfn_ma(ctx, NULL, (n + 1) * sizeof(ssfn_rect_t)))) return NULL;
+    /* the lines would cross the glyphs' rectangles */
+    st = ctx->style; ctx->style = (ctx->style & ~(SSFN_STYLE_UNDERLINE | SSFN_STYLE_STHROUGH)) | SSFN_STYLE_BUFFMT;
+    /* render every glyph to an alpha mask to find the pixels it actually sets, this also puts its sketch in the cache */
+    for(c = str, n = 0; *c; c += l) {
+        SSFN_memset(&r[n], 0, sizeof(ssfn_rect_t));
+        r[n].unicode = _ssfn_u((const uint8_t*)c, &l);
+        if(r[n].unicode < 32) continue;
+        for(i = 0; i < l && i < 7; i++) u[i] = c[i];
+        u[i] = 0;
+        SSFN_memset(&s, 0, sizeof(ssfn_buf_t)); ctx->line = 0;
+        if((ret = ssfn_render(ctx, &s, u)) < 1 || !ctx->g) {
+            if(ret == SSFN_ERR_NOGLYPH) { n++; continue; }
+            goto end;
+        }
+        /* the scaled glyph is at most p * line / h wide (see ssfn_text) and line tall, starting at the pen minus ox, oy */
+        bw = (ctx->g->p * ctx->line + ctx->g->h - 1) / ctx->g->h + 2; bh = ctx->line;
+        if(bw * bh > nd) {
+            nd = bw * bh;
+            if(!(d = (uint8_t*)_ssfn_ma(ctx, d, nd))) goto end;
+        }
+        SSFN_memset(d, 0, bw * bh);
+        s.ptr = d; s.w = bw; s.h = bh; s.p = bw; s.f = SSFN_FMT_A8; s.fg = fg; s.fx = 0;
+        s.x = x = ctx->ox; s.y = y = ctx->oy;
+        if(ssfn_render(ctx, &s, u) < 1) goto end;
+        r[n].ax = s.x - x; r[n].ay = s.y - y;
+        x0 = bw; y0 = bh; x1 = y1 = -1;
+        for(j = k = 0; j < bh; j++)
+            for(i = 0; i < bw; i++, k++)
+                if(d[k]) {
+                    if(i < x0) { x0 = i; } if(i > x1) { x1 = i; }
+                    if(j < y0) { y0 = j; } y1 = j;
+                }
+        if(x1 >= 0) {
+            r[n].w = x1 - x0 + 1; r[n].h = y1 - y0 + 1; r[n].l = x0 - x; r[n].t = y0 - y;
+            if(r[n].w > mw) mw = r[n].w;
+            if(r[n].h > mh) mh = r[n].h;
+            a += (long)(r[n].w + 1) * (r[n].h + 1);
+        }
+        n++;
+    }
+    /* shelf packing with one pixel padding: tallest glyphs first, left to right, new shelf when the row is full */
+    if(!w) for(w = 16; (long)w * w < a || w < mw + 2; w <<= 1);
+    if(w < mw + 2 || w * SSFN_FMT_BPP(fmt) > 65535) goto end;
+    if(!(o = (int*)_ssfn_ma(ctx, NULL, (n + mh + 1) * sizeof(int)))) goto end;
+    SSFN_memset(o + n, 0, (mh + 1) * sizeof(int));
+    for(i = 0; i < n; i++) o[n + mh - r[i].h]++;
+    for(k = j = 0; k <= mh; k++) { i = o[n + k]; o[n + k] = j; j += i; }
+    for(i = 0; i < n; i++) o[o[n + mh - r[i].h]++] = i;
+    for(x = y = 1, sh = j = 0; j < n && r[o[j]].w; j++) {
+        i = o[j];
+        if(x + r[i].w + 1 > w) { x = 1; y += sh + 1; sh = 0; }
+        r[i].x = x; r[i].y = y; x += r[i].w + 1;
+        if(r[i].h > sh) sh = r[i].h;
+    }
+    h = y + sh + 1;
+    k = sizeof(ssfn_atlas_t) + n * sizeof(ssfn_rect_t);
+    if(h > 32767 || (0x7FFFFFFF - k) / h < w * SSFN_FMT_BPP(fmt)) goto end;
+    if(!(atlas = (ssfn_atlas_t*)_ssfn_ma(ctx, NULL, k + w * h * SSFN_FMT_BPP(fmt)))) goto end;
+    SSFN_memset(atlas, 0, k + w * h * SSFN_FMT_BPP(fmt));
+    atlas->n = n; atlas->r = (ssfn_rect_t*)(atlas + 1);
+    for(i = 0; i < n; i++) atlas->r[i] = r[i];
+    atlas->buf.ptr = (uint8_t*)atlas + k; atlas->buf.w = w; atlas->buf.h = h; atlas->buf.p = w * SSFN_FMT_BPP(fmt);
+    atlas->buf.f = fmt; atlas->buf.fg = fg;
+    /* render the glyphs again, cropped to their rectangles. Blending over the zeroed atlas gives premultiplied colors,
+     * so straight alpha is rendered as PARGB and divided by the alpha afterwards, otherwise the edges would be darker */
+    for(c = str, n = 0; *c; c += l) {
+        if(_ssfn_u((const uint8_t*)c, &l) < 32) continue;
+        if(r[n].w) {
+            for(i = 0; i < l && i < 7; i++) u[i] = c[i];
+            u[i] = 0;
+            s = atlas->buf; s.f = fmt == SSFN_FMT_ARGB ? SSFN_FMT_PARGB : fmt;
+            s.ptr += r[n].y * s.p + r[n].x * SSFN_FMT_BPP(fmt); s.w = r[n].w; s.h = r[n].h; s.x = -r[n].l; s.y = -r[n].t;
+            ctx->line = 0;
+            if(ssfn_render(ctx, &s, u) < 1) { _ssfn_mf(ctx, atlas); atlas = NULL; goto end; }
+            if(fmt == SSFN_FMT_ARGB)
+                for(y = 0; y < r[n].h; y++)
+                    for(x = 0, q = (uint32_t*)(s.ptr + y * s.p); x < r[n].w; x++, q++)
+                        if((i = *q >> 24) && i < 255)
+                            *q = (*q & 0xFF000000) | ((((*q >> 16) & 0xFF) * 255 + i / 2) / i << 16) |
+                                ((((*q >> 8) & 0xFF) * 255 + i / 2) / i << 8) | (((*q & 0xFF) * 255 + i / 2) / i);
+        }
+        n++;
+    }
+end:
+    ctx->style = st;
+    if(d) _ssfn_mf(ctx, d);
+    if(o) _ssfn_mf(ctx, o);
+    _ssfn_mf(ctx, r);
+    return atlas;
 #else
     (void)ctx;
     (void)str;
     (void)fg;
+    (void)fmt;
+    (void)w;
     return NULL;
 #endif
 }
 
+/**
+ * Rasterize a range of code points into the glyph cache with the selected face, size and style ahead of time, so
+ * that rendering them later only has to blit. Code points that no font has are skipped
+ *
+ * @param ctx rendering context
+ * @param first first code point
+ * @param last last code point (inclusive)
+ * @return number of glyphs cached or error code
+ */
+int ssfn_preload(ssfn_t *ctx, uint32_t first, uint32_t last)
+{
+#if !defined(SSFN_MAXLINES) || defined(SSFN_STATICCACHE)
+    ssfn_buf_t b;
+    uint8_t px = 0;
+    char u[5];
+    uint32_t c;
+    int ret = 0, n = 0, i, st, ln;
+
+    if(!ctx || first > last || last > 0x10FFFF) return SSFN_ERR_INVINP;
+    if(ctx->style & SSFN_STYLE_NOCACHE) return 0;
+    st = ctx->style; ln = ctx->line; ctx->style |= SSFN_STYLE_NODEFGLYPH;
+    for(c = first < 32 ? 32 : first; c <= last && ret >= 0; c++) {
+        if(c >= 0xD800 && c < 0xE000) continue;
+        if(c < 0x80) { u[0] = c; u[1] = 0; } else
+        if(c < 0x800) { u[0] = 0xC0 | (c >> 6); u[1] = 0x80 | (c & 0x3F); u[2] = 0; } else
+        if(c < 0x10000) { u[0] = 0xE0 | (c >> 12); u[1] = 0x80 | ((c >> 6) & 0x3F); u[2] = 0x80 | (c & 0x3F); u[3] = 0; }
+        else {
+            u[0] = 0xF0 | (c >> 18); u[1] = 0x80 | ((c >> 12) & 0x3F); u[2] = 0x80 | ((c >> 6) & 0x3F);
+            u[3] = 0x80 | (c & 0x3F); u[4] = 0;
+        }
+        /* with a pixel buffer render caches the masks too (one for each pen phase), but the pen is below it, so
+         * nothing is drawn */
+        for(i = 0; i < (st & SSFN_STYLE_SUBPIXEL ? SSFN_SUBPIXEL : 1) && ret >= 0; i++) {
+            SSFN_memset(&b, 0, sizeof(ssfn_buf_t));
+            b.ptr = &px; b.y = 16384; b.fx = i * 64 / SSFN_SUBPIXEL;
+            ret = ssfn_render(ctx, &b, u);
+        }
+        if(ret > 0) n++; else
+        if(ret == SSFN_ERR_NOGLYPH) ret = 0;
+    }
+    ctx->style = st; ctx->line = ln;
+    return ret < 0 ? ret : n;
+#else
+    if(!ctx || first > last || last > 0x10FFFF) return SSFN_ERR_INVINP;
+    return 0;
+#endif
+}
+
 #endif /* SSFN_IMPLEMENTATION */
 
 #if defined(SSFN_CONSOLEBITMAP_PALETTE) || defined(SSFN_CONSOLEBITMAP_HICOLOR) || defined(SSFN_CONSOLEBITMAP_TRUECOLOR)
@@ -1568,6 +3251,8 @@ namespace SSFN {
         public:
             int Load(const std::string &data);
             int Load(const unsigned char *data, int len);
+            int Map(const unsigned char *data);
+            int Share(const Font &fonts);
             int Select(int family, const std::string &name, int style, int size);
             int Select(int family, const char *name, int style, int size);
             int Render(ssfn_buf_t *dst, const std::string &str);
@@ -1576,8 +3261,15 @@ namespace SSFN {
             int BBox(const char *str, int *w, int *h, int *left, int *top);
             ssfn_buf_t *Text(const std::string &str, unsigned int fg);
             ssfn_buf_t *Text(const char *str, unsigned int fg);
+            ssfn_atlas_t *Atlas(const std::string &str, unsigned int fg, int fmt, int w);
+            ssfn_atlas_t *Atlas(const char *str, unsigned int fg, int fmt, int w);
             int LineHeight();
             int Mem();
+            void Flush();
+            void CacheSize(int size);
+            int Allocator(void *(*alloc)(void *data, void *ptr, int size), void (*release)(void *data, void *ptr), void *data);
+            int Stats(ssfn_stats_t *stats, int reset);
+            int Preload(uint32_t first, uint32_t last);
             const std::string ErrorStr(int err);
     };
 #else
@@ -1592,6 +3284,8 @@ namespace SSFN {
         public:
             int Load(const std::string &data) { return ssfn_load(&this->ctx,(const void*)data.data()); }
             int Load(const unsigned char *data) { return ssfn_load(&this->ctx, (const void*)data); }
+            int Map(const unsigned char *data) { return ssfn_map(&this->ctx, (const void*)data); }
+            int Share(const Font &fonts) { return ssfn_share(&this->ctx, &fonts.ctx); }
             int Select(int family, const std::string &name, int style, int size)
                 { return ssfn_select(&this->ctx, family, (char*)name.data(), style, size); }
             int Select(int family, char *name, int style, int size) { return ssfn_select(&this->ctx,family,name,style,size); }
@@ -1603,8 +3297,17 @@ namespace SSFN {
             ssfn_buf_t *Text(const std::string &str, unsigned int fg)
                 { return ssfn_text(&this->ctx,(const char*)str.data(), fg); }
             ssfn_buf_t *Text(const char *str, unsigned int fg) { return ssfn_text(&this->ctx, str, fg); }
+            ssfn_atlas_t *Atlas(const std::string &str, unsigned int fg, int fmt, int w)
+                { return ssfn_atlas(&this->ctx, (const char*)str.data(), fg, fmt, w); }
+            ssfn_atlas_t *Atlas(const char *str, unsigned int fg, int fmt, int w) { return ssfn_atlas(&this->ctx,str,fg,fmt,w); }
             int LineHeight() { return this->ctx.line ? this->ctx.line : this->ctx.size; }
             int Mem() { return ssfn_mem(&this->ctx); }
+            void Flush() { ssfn_flush(&this->ctx); }
+            void CacheSize(int size) { ssfn_cachesize(&this->ctx, size); }
+            int Allocator(void *(*alloc)(void *data, void *ptr, int size), void (*release)(void *data, void *ptr), void *data)
+                { return ssfn_allocator(&this->ctx, alloc, release, data); }
+            int Stats(ssfn_stats_t *stats, int reset) { return ssfn_stats(&this->ctx, stats, reset); }
+            int Preload(uint32_t first, uint32_t last) { return ssfn_preload(&this->ctx, first, last); }
             const std::string ErrorStr(int err) { return std::string(ssfn_error(err)); }
     };
 #endif